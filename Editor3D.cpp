@@ -5,6 +5,7 @@
 #include "Settings.h"
 
 #include <imgui_stdlib.h>
+#include <glm/trigonometric.hpp>
 
 static const std::unordered_map<EditorTool, EventType> toolToEvents = {
     { EditorTool::CreateFace, EventType::ChangeTool_CreateFace },
@@ -286,6 +287,40 @@ void Editor3D::DrawModifyBox()
     ImGui::Button("Mirror", ImVec2(-1, 0));
     ImGui::Button("Delete", ImVec2(-1, 0));
     ImGui::EndGroup();
+    ImGui::SeparatorText("Mesh Tools");
+    ImGui::BeginGroup();
+    if (ImGui::Button("Weld Vertices", ImVec2(-1, 0)))
+        model().mutator().weldVertices(_weldTolerance);
+    ImGui::PushItemWidth(-1);
+    ImGui::InputFloat("##WeldTolerance", &_weldTolerance, 0.001f, 0.01f, "Distance: %.3f");
+    _weldTolerance = std::max(0.0f, _weldTolerance);
+    ImGui::PopItemWidth();
+    if (ImGui::Button("Compact", ImVec2(-1, 0)))
+        model().mutator().compactMeshes();
+    ImGui::SetItemTooltip("Remove unused vertices and texcoords, and degenerate triangles.");
+    if (ImGui::Button("Recompute Normals", ImVec2(-1, 0)))
+        model().mutator().recomputeNormals(_creaseAngle < 180.0f ? std::optional(glm::radians(_creaseAngle)) : std::nullopt);
+    ImGui::PushItemWidth(-1);
+    ImGui::SliderFloat("##CreaseAngle", &_creaseAngle, 0.0f, 180.0f, "Crease: %.0f deg");
+    ImGui::PopItemWidth();
+    if (ImGui::Button("Clean Up", ImVec2(-1, 0)))
+    {
+        auto mutator = model().mutator();
+        ModelTransaction transaction(mutator, "Clean Up Mesh");
+        mutator.weldVertices(_weldTolerance);
+        mutator.compactMeshes();
+        mutator.recomputeNormals(_creaseAngle < 180.0f ? std::optional(glm::radians(_creaseAngle)) : std::nullopt);
+    }
+    ImGui::SetItemTooltip("Weld, compact and recompute normals, as one undo step.");
+    if (ImGui::Button("Generate LOD", ImVec2(-1, 0)))
+        model().mutator().generateLOD((size_t) _lodTriangles);
+    ImGui::SetItemTooltip("Add a decimated copy of the mesh; UV seams and borders are kept.");
+    ImGui::PushItemWidth(-1);
+    const int32_t lodStep = 50, lodStepFast = 500;
+    ImGui::InputScalar("##LODTriangles", ImGuiDataType_S32, &_lodTriangles, &lodStep, &lodStepFast, "Triangles: %d");
+    _lodTriangles = std::max(1, _lodTriangles);
+    ImGui::PopItemWidth();
+    ImGui::EndGroup();
 
     ImGui::End();
 }
@@ -323,7 +358,8 @@ void Editor3D::DrawToolBox()
     ImGui::SeparatorText("Frame Range");
 
     ImGui::BeginGroup();
-    ImGui::Button("Affect Range", ImVec2(-1, 0));
+    if (ImGui::qmdlr::CheckBoxButton("Affect Range", _frameRange.active, ImVec2(-1, 0)))
+        _frameRange.active = !_frameRange.active;
     
     if (ImGui::BeginTable("Frame Range", 2))
     {
@@ -334,18 +370,18 @@ void Editor3D::DrawToolBox()
         ImGui::TableNextColumn();
         ImGui::Text("From");
         ImGui::TableNextColumn();
-        int from = 0;
         ImGui::PushItemWidth(-1);
-        ImGui::InputInt("##RangeFrom", &from);
+        ImGui::InputInt("##RangeFrom", &_frameRange.from);
+        _frameRange.from = std::clamp(_frameRange.from, 0, (int) model().model().frames.size() - 1);
         ImGui::PopItemWidth();
 
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         ImGui::Text("To");
         ImGui::TableNextColumn();
-        int to = 0;
         ImGui::PushItemWidth(-1);
-        ImGui::InputInt("##RangeTo", &to);
+        ImGui::InputInt("##RangeTo", &_frameRange.to);
+        _frameRange.to = std::clamp(_frameRange.to, _frameRange.from, (int) model().model().frames.size() - 1);
         ImGui::PopItemWidth();
 
         ImGui::EndTable();
@@ -433,6 +469,24 @@ void Editor3D::DrawTimelineWindow()
 
     ImGui::PopItemWidth();
 
+    // tweens go between every frame of the range, or
+    // after the current frame if there's no range
+    int32_t tweenFirst = _frameRange.active ? _frameRange.from : currentFrame;
+    int32_t tweenLast = _frameRange.active ? _frameRange.to : currentFrame + 1;
+
+    ImGui::BeginDisabled(tweenLast <= tweenFirst || tweenLast >= (int32_t) model().model().frames.size());
+    if (ImGui::Button("Insert Tweens"))
+        model().mutator().insertTweenFrames(tweenFirst, tweenLast, _tweenCount, _tweenSlerpNormals);
+    ImGui::SetItemTooltip(_frameRange.active ? "Insert interpolated frames between each frame of the range." : "Insert interpolated frames after this frame.");
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::PushItemWidth(80);
+    ImGui::InputInt("##TweenCount", &_tweenCount, 1);
+    _tweenCount = std::clamp(_tweenCount, 1, 64);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Checkbox("Slerp Normals", &_tweenSlerpNormals);
+
     ImGui::End();
 }
 
@@ -63,6 +63,15 @@ struct AnimationParams
     double time = 0;
 };
 
+// frames that 3D transforms apply to, if active;
+// otherwise only the selected frame is changed.
+struct FrameRangeParams
+{
+    bool active = false;
+    int from = 0;
+    int to = 0;
+};
+
 class Editor3D
 {
 public:
@@ -74,6 +83,7 @@ public:
     SelectMode &editorSelectMode() { return _editorSelectMode; }
     MDLRenderer &renderer() { return _renderer; }
     AnimationParams &animation() { return _animation; }
+    FrameRangeParams &frameRange() { return _frameRange; }
 
 private:
     // 3d editor
@@ -96,6 +106,13 @@ private:
     EditorTool _editorTool = EditorTool::Pan;
     ModifyAxis _editorAxis = {};
     SelectMode _editorSelectMode = SelectMode::Vertex;
+    FrameRangeParams _frameRange = {};
+    float _weldTolerance = 0.01f;
+    // degrees; 180 smooths across every edge
+    float _creaseAngle = 180.0f;
+    int32_t _lodTriangles = 500;
+    int32_t _tweenCount = 1;
+    bool _tweenSlerpNormals = true;
 
     // separate widgets
     MDLRenderer _renderer;
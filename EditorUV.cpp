@@ -5,6 +5,8 @@
 #include "Settings.h"
 #include "ModelLoader.h"
 #include "Images.h"
+#include "Format.h"
+#include "Log.h"
 
 static const std::unordered_map<EditorTool, EventType> toolToEvents = {
     { EditorTool::Move, EventType::ChangeTool_Move },
@@ -155,10 +157,23 @@ void EditorUV::Init()
         nfdresult_t result = NFD_OpenDialog(&inPath, images().SupportedFormats().data(), images().SupportedFormats().size(), settings().modelDialogLocation.c_str());
         if (result == NFD_OKAY)
         {
-            Image img = images().Load(inPath);
+            // read the header before committing to a full decode
+            auto info = images().Info(inPath);
 
-            if (img.is_valid())
-                model().mutator().importSkin(img);
+            if (!info)
+                logger().AddLog("{} isn't an image qmdlr can read.", inPath);
+            else
+            {
+                auto skin = model().model().getSelectedSkin();
+
+                if (skin && (info->width != (uint32_t) skin->width || info->height != (uint32_t) skin->height))
+                    logger().AddLog("Imported skin is {}x{}; the skin it replaces was {}x{}.", info->width, info->height, skin->width, skin->height);
+
+                Image img = images().Load(inPath);
+
+                if (img.is_valid())
+                    model().mutator().importSkin(img);
+            }
             NFD_FreePath(inPath);
         }
     });
@@ -318,6 +333,114 @@ void EditorUV::DrawMove()
     }
 }
 
+void EditorUV::DrawExportAll()
+{
+    static constexpr const char *formatExtensions[] = { ".png", ".tga", ".pcx" };
+
+    if (_showExportAll)
+    {
+        ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+        ImGui::OpenPopup("Export All Skins");
+
+        _showExportAll = false;
+    }
+
+    if (ImGui::BeginPopupModal("Export All Skins", nullptr, ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoDocking | ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        if (_exportJob)
+        {
+            float progress = (float) _exportJob->Completed() / _exportJob->Total();
+            StackFormat<64> overlay;
+            overlay.Format("{} / {}", _exportJob->Completed(), _exportJob->Total());
+            ImGui::ProgressBar(progress, ImVec2(300, 0), overlay.c_str());
+
+            if (!_exportJob->Finished())
+                sys().WantsRedraw();
+            else
+            {
+                double seconds = std::max(_exportJob->Seconds(), 0.0001);
+                double mb = _exportJob->BytesWritten() / 1024.0 / 1024.0;
+
+                ImGui::Text("%.2f skins/s, %.2f MB/s", _exportJob->Total() / seconds, mb / seconds);
+
+                if (_exportJob->Failed())
+                    ImGui::TextColored(ImVec4(1, 0.3f, 0.3f, 1), "%zu skin(s) failed to export", _exportJob->Failed());
+
+                if (ImGui::Button("Close"))
+                {
+                    logger().AddLog("Exported {} skins ({:.2f} MB) in {:.2f}s on {} threads; {:.2f} skins/s, {:.2f} MB/s",
+                        _exportJob->Total() - _exportJob->Failed(), mb, seconds, _exportJob->Threads(), _exportJob->Total() / seconds, mb / seconds);
+                    _exportJob.reset();
+                    ImGui::CloseCurrentPopup();
+                }
+            }
+        }
+        else
+        {
+            ImGui::AlignTextToFramePadding();
+            ImGui::Text("Format");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120);
+            ImGui::Combo("##Format", &_exportFormat, "PNG\0TGA\0PCX\0\0");
+
+            ImGui::BeginDisabled(_exportFormat != 0);
+            ImGui::AlignTextToFramePadding();
+            ImGui::Text("PNG Compression");
+            ImGui::SameLine();
+            HelpMarker("zlib compression level used for PNG files. Lower levels write much faster, but produce larger files.");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120);
+            ImGui::SliderInt("##PNGCompression", &_exportPNGCompression, 0, 9);
+            ImGui::EndDisabled();
+
+            if (ImGui::Button("Export..."))
+            {
+                nfdchar_t *outPath;
+                nfdresult_t result = NFD_PickFolder(&outPath, settings().modelDialogLocation.c_str());
+
+                if (result == NFD_OKAY)
+                {
+                    std::filesystem::path folder(outPath);
+                    NFD_FreePath(outPath);
+
+                    std::vector<ImageExportJob::Entry> entries;
+                    std::unordered_set<std::string> usedNames;
+                    auto &skins = model().model().skins;
+
+                    for (size_t i = 0; i < skins.size(); i++)
+                    {
+                        auto &skin = skins[i];
+
+                        if (!skin.image.is_valid())
+                            continue;
+                        // PCX can only store paletted skins
+                        else if (_exportFormat == 2 && !skin.image.is_indexed_valid())
+                            continue;
+
+                        // skin names are often paths; only keep the file part,
+                        // and make sure two skins never write the same file.
+                        std::string name = std::filesystem::path(skin.name).stem().string();
+
+                        if (name.empty() || usedNames.contains(name))
+                            name = std::format("{}_{}", name.empty() ? "skin" : name, i);
+
+                        usedNames.insert(name);
+                        entries.push_back({ skin.image, (folder / name).replace_extension(formatExtensions[_exportFormat]) });
+                    }
+
+                    _exportJob = std::make_unique<ImageExportJob>(std::move(entries), _exportPNGCompression);
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel"))
+                ImGui::CloseCurrentPopup();
+        }
+
+        ImGui::EndPopup();
+    }
+}
+
 void EditorUV::Draw()
 {
     ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
@@ -337,6 +460,8 @@ void EditorUV::Draw()
             {
                 ImGui::qmdlr::MenuItemWithEvent("Import...", EventType::ImportSkin, EventContext::EditorUV);
                 ImGui::qmdlr::MenuItemWithEvent("Export...", EventType::ExportSkin, EventContext::EditorUV);
+                if (ImGui::MenuItem("Export All Skins...", nullptr, nullptr, !model().model().skins.empty()))
+                    _showExportAll = true;
                 ImGui::Separator();
                 ImGui::qmdlr::MenuItemWithEvent("Add Skin", EventType::AddSkin, EventContext::EditorUV);
                 ImGui::qmdlr::MenuItemWithEvent("Delete Skin", EventType::DeleteSkin, EventContext::EditorUV);
@@ -395,6 +520,7 @@ void EditorUV::Draw()
 
     DrawResize();
     DrawMove();
+    DrawExportAll();
 }
 
 void EditorUV::DrawUVToolBox()
@@ -488,12 +614,44 @@ void EditorUV::DrawUVSkinSelector()
     ImGui::Text("Active Skin");
     ImGui::SameLine();
     ImGui::PushItemWidth(-1);
-    if (ImGui::Combo("##Active Skin", &item, [](void *, int idx) -> const char *
+    if (ImGui::BeginCombo("##Active Skin", item >= 0 ? model().model().skins[item].name.c_str() : ""))
     {
-        return model().model().skins[idx].name.c_str();
-    }, nullptr, model().model().skins.size()))
-    {
-        model().mutator().setSelectedSkin(item);
+        // thumbnails come from the shared atlas, so listing
+        // every skin doesn't touch the full-size textures.
+        constexpr float thumbnailSize = 32.f;
+        const auto &thumbnails = ui().editor3D().renderer().skinThumbnails();
+        const auto &skins = model().model().skins;
+
+        for (int i = 0; i < skins.size(); i++)
+        {
+            ImGui::PushID(i);
+
+            float startX = ImGui::GetCursorPosX();
+            bool selected = i == item;
+
+            if (ImGui::Selectable("##Skin", selected, 0, ImVec2(0, thumbnailSize)))
+                model().mutator().setSelectedSkin(i);
+
+            if (selected)
+                ImGui::SetItemDefaultFocus();
+
+            ImGui::SameLine(startX);
+
+            if (auto thumb = thumbnails.thumbnail(i))
+            {
+                float scale = thumbnailSize / SkinThumbnailAtlas::CELL_SIZE;
+                ImGui::Image(thumb->texture, { thumb->size.x * scale, thumb->size.y * scale }, thumb->uv0, thumb->uv1);
+            }
+            else
+                ImGui::Dummy({ thumbnailSize, thumbnailSize });
+
+            ImGui::SameLine(startX + thumbnailSize + ImGui::GetStyle().ItemSpacing.x);
+            ImGui::TextUnformatted(skins[i].name.c_str());
+
+            ImGui::PopID();
+        }
+
+        ImGui::EndCombo();
     }
     ImGui::PopItemWidth();
     
@@ -5,6 +5,7 @@
 
 #include "Editor3D.h"
 #include "UVRenderer.h"
+#include "Images.h"
 
 // UV editor stuff
 enum class LineDisplayMode
@@ -45,6 +46,7 @@ private:
     // dialogs
     void DrawResize();
     void DrawMove();
+    void DrawExportAll();
 
     // uv state
     EditorTool _uvTool = EditorTool::Select;
@@ -66,4 +68,9 @@ private:
     bool _showMove = false;
     int _moveTarget = 0;
     int _moveDir = 0;
+
+    bool _showExportAll = false;
+    int _exportFormat = 0;
+    int _exportPNGCompression = 8;
+    std::unique_ptr<ImageExportJob> _exportJob;
 };
\ No newline at end of file
@@ -17,4 +17,32 @@ public:
 
 private:
 	char data[N] = { '\0' };
-};
\ No newline at end of file
+};
+
+// format a byte count with a human-readable unit
+template<size_t N>
+inline void FormatByteSize(StackFormat<N> &out, size_t bytes)
+{
+	struct {
+		size_t      ratio;
+		const char  *label;
+	} labels[] = {
+		{ 1000000000, "gb" },
+		{ 1000000, "mb" },
+		{ 1000, "kb" },
+		{ 0, "b" }
+	};
+
+	for (auto &ratio : labels)
+	{
+		if (bytes >= ratio.ratio)
+		{
+			if (ratio.ratio)
+				out.Format("{:.2f} {}", (double) bytes / ratio.ratio, ratio.label);
+			else
+				out.Format("{} {}", bytes, ratio.label);
+
+			break;
+		}
+	}
+}
\ No newline at end of file
@@ -2,11 +2,18 @@
 #define STBI_ONLY_JPEG
 #define STBI_ONLY_PNG
 #define STBI_ONLY_TGA
+// only reached through the catch-all decoder below
+#define STBI_ONLY_BMP
+#define STBI_ONLY_GIF
+#define STBI_ONLY_PSD
+#define STBI_ONLY_HDR
 #include <stb_image/stb_image.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image/stb_image_write.h>
 
 #include <fstream>
+#include <limits>
+#include <mutex>
 #include "Images.h"
 #include "ModelData.h"
 
@@ -98,29 +105,44 @@ struct pcx_t
 	}
 };
 
-static Image LoadPCX (const std::filesystem::path &file)
+static bool ReadPCXHeader (std::istream &stream, pcx_t &pcx)
 {
-	if (!std::filesystem::exists(file))
-        throw std::runtime_error("non-existent file");
-
-	std::ifstream stream(file, std::ios_base::binary | std::ios_base::in);
-
-    if (!stream.good())
-        throw std::runtime_error("can't open file for reading");
-
 	stream >> endianness<std::endian::little>;
 
-	pcx_t pcx;
-
 	stream >= pcx;
 
-    if (pcx.manufacturer != 0x0a
+    if (!stream
+		|| pcx.manufacturer != 0x0a
 		|| pcx.version != 5
 		|| pcx.encoding != 1
 		|| pcx.bits_per_pixel != 8
 		|| pcx.xmax >= 640
 		|| pcx.ymax >= 480)
-        return {};
+        return false;
+
+	return true;
+}
+
+static std::optional<ImageInfo> InfoPCX (std::span<const uint8_t> data)
+{
+	memory_streambuf buf(data);
+	std::istream stream(&buf);
+	pcx_t pcx;
+
+	if (!ReadPCXHeader(stream, pcx))
+		return std::nullopt;
+
+	return ImageInfo { (uint32_t) pcx.xmax + 1, (uint32_t) pcx.ymax + 1, true };
+}
+
+static Image LoadPCX (std::span<const uint8_t> data)
+{
+	memory_streambuf buf(data);
+	std::istream stream(&buf);
+	pcx_t pcx;
+
+	if (!ReadPCXHeader(stream, pcx))
+		return {};
 
     Image img = Image::create_indexed(pcx.xmax + 1, pcx.ymax + 1);
 
@@ -141,7 +163,7 @@ static Image LoadPCX (const std::filesystem::path &file)
                 stream >= dataByte;
 			}
 
-			while (runLength-- > 0)
+			while (runLength-- > 0 && x <= pcx.xmax)
 				pix[x++] = dataByte;
 		}
 
@@ -209,45 +231,207 @@ static void SavePCX (const Image &image, const std::filesystem::path &file)
 	stream.write(reinterpret_cast<const char *>(image.palette()), image.palette_size());
 }
 
+// stb-backed formats
+static std::optional<ImageInfo> InfoSTBI (std::span<const uint8_t> data)
+{
+	int w, h;
+
+	if (stbi_info_from_memory(data.data(), data.size(), &w, &h, nullptr) != 1)
+		return std::nullopt;
+
+	return ImageInfo { (uint32_t) w, (uint32_t) h, false };
+}
+
+static Image LoadSTBI (std::span<const uint8_t> data)
+{
+	int w, h;
+	stbi_uc *stbi = stbi_load_from_memory(data.data(), data.size(), &w, &h, nullptr, 4);
+
+	if (!stbi)
+		return {};
+
+	// the image takes stb's buffer as-is
+	Image img;
+	img.width = w;
+	img.height = h;
+	img.data = PixelBuffer::adopt(stbi, (size_t) w * h * 4, stbi_image_free);
+	return img;
+}
+
+static bool SniffPNG (std::span<const uint8_t> header)
+{
+	static constexpr uint8_t magic[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	return header.size() >= sizeof(magic) && !memcmp(header.data(), magic, sizeof(magic));
+}
+
+static bool SniffJPEG (std::span<const uint8_t> header)
+{
+	return header.size() >= 3 && header[0] == 0xff && header[1] == 0xd8 && header[2] == 0xff;
+}
+
+static bool SniffPCX (std::span<const uint8_t> header)
+{
+	return header.size() >= 4 && header[0] == 0x0a && header[1] == 5 && header[2] == 1 && header[3] == 8;
+}
+
+// TGA has no magic, so this only rejects headers that
+// can't possibly be a type stb understands.
+static bool SniffTGA (std::span<const uint8_t> header)
+{
+	if (header.size() < 18)
+		return false;
+
+	uint8_t colormap = header[1], type = header[2];
+
+	return colormap <= 1 && (type == 1 || type == 2 || type == 3 || type == 9 || type == 10 || type == 11);
+}
+
+// anything else stb recognizes (BMP, GIF, PSD, HDR...)
+static bool SniffSTBI (std::span<const uint8_t> header)
+{
+	int w, h, comp;
+	return stbi_info_from_memory(header.data(), header.size(), &w, &h, &comp) == 1;
+}
+
+// nb: order matters; formats with real magic numbers
+// must come before TGA, and stb's own probing goes last.
+static const ImageDecoder decoders[] = {
+	{ "PNG",  SniffPNG,  InfoSTBI, LoadSTBI },
+	{ "JPEG", SniffJPEG, InfoSTBI, LoadSTBI },
+	{ "PCX",  SniffPCX,  InfoPCX,  LoadPCX },
+	{ "TGA",  SniffTGA,  InfoSTBI, LoadSTBI },
+	{ "stb",  SniffSTBI, InfoSTBI, LoadSTBI }
+};
+
+// enough to cover every header we sniff, and the
+// start of most JPEGs for Info.
+static constexpr size_t IMAGE_HEADER_PEEK = 64 * 1024;
+
+static std::vector<uint8_t> ReadImageFile (const std::filesystem::path &file, size_t max_size = std::numeric_limits<size_t>::max())
+{
+	std::ifstream stream(file, std::ios_base::binary | std::ios_base::in);
+
+    if (!stream.good())
+        throw std::runtime_error("can't open file for reading");
+
+	stream.seekg(0, std::ios_base::end);
+	size_t size = std::min((size_t) stream.tellg(), max_size);
+	stream.seekg(0, std::ios_base::beg);
+
+	std::vector<uint8_t> data(size);
+	stream.read(reinterpret_cast<char *>(data.data()), size);
+	return data;
+}
+
+const ImageDecoder *ImageLoader::FindDecoder(const std::span<const uint8_t, std::dynamic_extent> &header) const
+{
+	for (auto &decoder : decoders)
+		if (decoder.sniff(header))
+			return &decoder;
+
+	return nullptr;
+}
+
 Image ImageLoader::Load(const std::filesystem::path &file)
 {
-	// TODO: detect via header
-	if (file.extension() == ".pcx")
-	    return LoadPCX(file);
-    else if (stbi_info(file.string().c_str(), nullptr, nullptr, nullptr) == 1)
-    {
-        int w, h;
-        stbi_uc *stbi = stbi_load(file.string().c_str(), &w, &h, nullptr, 4);
-        Image img = Image::create_rgba(w, h);
-        memcpy(img.data.data(), stbi, w * h * 4);
-        stbi_image_free(stbi);
-        return img;
-    }
-	else
-        return {};
+	if (!std::filesystem::exists(file))
+        throw std::runtime_error("non-existent file");
+
+	auto data = ReadImageFile(file);
+	return Load(data);
 }
 
 Image ImageLoader::Load(const std::span<const uint8_t, std::dynamic_extent> &data)
 {
-    if (stbi_info_from_memory(data.data(), data.size(), nullptr, nullptr, nullptr) == 1)
-    {
-        int w, h;
-        stbi_uc *stbi = stbi_load_from_memory(data.data(), data.size(), &w, &h, nullptr, 4);
-        Image img = Image::create_rgba(w, h);
-        memcpy(img.data.data(), stbi, w * h * 4);
-        stbi_image_free(stbi);
-        return img;
-    }
+	if (auto decoder = FindDecoder(data))
+		return decoder->decode(data);
 
     return {};
 }
 
-void ImageLoader::Save(const Image &skin, const std::filesystem::path &file) const
+std::optional<ImageInfo> ImageLoader::Info(const std::filesystem::path &file)
+{
+	if (!std::filesystem::exists(file))
+        return std::nullopt;
+
+	auto data = ReadImageFile(file, IMAGE_HEADER_PEEK);
+
+	if (auto info = Info(data))
+		return info;
+	// JPEG can have its frame header past our peek
+	else if (data.size() == IMAGE_HEADER_PEEK)
+		return Info(ReadImageFile(file));
+
+	return std::nullopt;
+}
+
+std::optional<ImageInfo> ImageLoader::Info(const std::span<const uint8_t, std::dynamic_extent> &data)
+{
+	if (auto decoder = FindDecoder(data))
+		return decoder->info(data);
+
+	return std::nullopt;
+}
+
+// stb reads the PNG compression level from a global, which can
+// only be written while no PNG write is reading it. the first
+// writer in sets the level; anyone joining while writes are under
+// way uses that level rather than waiting, as it only trades file
+// size for speed. the global is back at stb's default whenever
+// nothing is writing.
+class PNGCompressionGate
+{
+public:
+	// returns the level writes will actually use
+	int Acquire(int level)
+	{
+		std::scoped_lock lock(_mutex);
+
+		if (!_writers++)
+			stbi_write_png_compression_level = _level = level;
+
+		return _level;
+	}
+
+	void Release()
+	{
+		std::scoped_lock lock(_mutex);
+
+		if (!--_writers)
+			stbi_write_png_compression_level = _level = ImageLoader::PNG_DEFAULT_COMPRESSION;
+	}
+
+private:
+	std::mutex	_mutex;
+	int			_level = ImageLoader::PNG_DEFAULT_COMPRESSION;
+	size_t		_writers = 0;
+};
+
+static PNGCompressionGate pngCompressionGate;
+
+void ImageLoader::Save(const Image &skin, const std::filesystem::path &file, int pngCompressionLevel) const
 {
 	if (file.extension() == ".pcx")
+	{
 		SavePCX(skin, file);
-	else if (file.extension() == ".png")
+		return;
+	}
+
+	// indexed skins are only expanded on demand
+	if (!skin.is_rgba_valid() && skin.is_indexed_valid())
+	{
+		Image rgba = skin;
+		rgba.convert_to_rgba();
+		Save(rgba, file, pngCompressionLevel);
+		return;
+	}
+
+	if (file.extension() == ".png")
+	{
+		pngCompressionGate.Acquire(std::clamp(pngCompressionLevel, 0, 9));
         stbi_write_png(file.string().c_str(), skin.width, skin.height, 4, skin.rgba(), skin.width * 4);
+		pngCompressionGate.Release();
+	}
 	else if (file.extension() == ".tga")
         stbi_write_tga(file.string().c_str(), skin.width, skin.height, 4, skin.rgba());
 	else if (file.extension() == ".jpg" ||
@@ -261,4 +445,66 @@ ImageLoader &images()
 {
     static ImageLoader instance;
     return instance;
+}
+
+ImageExportJob::ImageExportJob(std::vector<Entry> entries, int pngCompressionLevel) :
+	_entries(std::move(entries)),
+	_start(std::chrono::steady_clock::now())
+{
+	size_t numWorkers = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(1, _entries.size()));
+
+	// the level is set once, before any worker writes; the
+	// last worker out lets go of it.
+	_pngCompressionLevel = pngCompressionGate.Acquire(std::clamp(pngCompressionLevel, 0, 9));
+	_activeWorkers = numWorkers;
+
+	for (size_t i = 0; i < numWorkers; i++)
+		_workers.emplace_back(&ImageExportJob::Work, this);
+}
+
+ImageExportJob::~ImageExportJob()
+{
+	for (auto &worker : _workers)
+		worker.join();
+}
+
+double ImageExportJob::Seconds() const
+{
+	if (Finished())
+		return _seconds;
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+}
+
+void ImageExportJob::Work()
+{
+	for (size_t i; (i = _next++) < _entries.size(); )
+	{
+		auto &entry = _entries[i];
+
+		try
+		{
+			images().Save(entry.image, entry.path, _pngCompressionLevel);
+			_bytesWritten += std::filesystem::file_size(entry.path);
+		}
+		catch (std::exception &)
+		{
+			_failed++;
+		}
+
+		// free the pixels as soon as we're done with them
+		entry.image = {};
+
+		// keep the latest finish time; it has to land before
+		// _completed does, so Seconds() never sees a stale value.
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+
+		for (double prev = _seconds; prev < elapsed && !_seconds.compare_exchange_weak(prev, elapsed); )
+			;
+
+		_completed++;
+	}
+
+	if (!--_activeWorkers)
+		pngCompressionGate.Release();
 }
\ No newline at end of file
@@ -5,14 +5,92 @@
 #include <filesystem>
 #include <nfd.hpp>
 #include <span>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <utility>
 #include "Types.h"
 
+// owned run of pixels. decoders like stb hand back their own
+// allocations, so this can adopt one (along with how to free it)
+// rather than copying it into a fresh buffer.
+class PixelBuffer
+{
+public:
+	using deleter_t = void (*)(void *);
+
+	PixelBuffer() = default;
+	PixelBuffer(PixelBuffer &&other) noexcept { *this = std::move(other); }
+	PixelBuffer(const PixelBuffer &other) { assign(other.data(), other.size()); }
+
+	PixelBuffer &operator=(PixelBuffer &&other) noexcept
+	{
+		_ptr = std::move(other._ptr);
+		_size = std::exchange(other._size, 0);
+		return *this;
+	}
+
+	PixelBuffer &operator=(const PixelBuffer &other)
+	{
+		if (this != &other)
+			assign(other.data(), other.size());
+
+		return *this;
+	}
+
+	// take ownership of `ptr`, which `deleter` frees
+	static PixelBuffer adopt(uint8_t *ptr, size_t size, deleter_t deleter)
+	{
+		PixelBuffer buffer;
+		buffer._ptr = { ptr, deleter };
+		buffer._size = size;
+		return buffer;
+	}
+
+	uint8_t *data() { return _ptr.get(); }
+	const uint8_t *data() const { return _ptr.get(); }
+	size_t size() const { return _size; }
+	bool empty() const { return !_size; }
+
+	// like std::vector; existing bytes are kept, new ones are zero
+	void resize(size_t size)
+	{
+		if (size == _size)
+			return;
+
+		PixelBuffer resized;
+		resized._ptr = { size ? new uint8_t[size]() : nullptr, DeleteArray };
+		resized._size = size;
+
+		if (size && _size)
+			memcpy(resized.data(), data(), std::min(size, _size));
+
+		*this = std::move(resized);
+	}
+
+	void assign(const uint8_t *src, size_t size)
+	{
+		resize(0);
+		resize(size);
+
+		if (size)
+			memcpy(data(), src, size);
+	}
+
+private:
+	static void DeleteArray(void *ptr) { delete[] reinterpret_cast<uint8_t *>(ptr); }
+
+	std::unique_ptr<uint8_t, deleter_t>	_ptr { nullptr, DeleteArray };
+	size_t								_size = 0;
+};
+
 // higher level representation of a 32-bit image
 struct Image
 {
 	uint32_t				width = 0;
 	uint32_t				height = 0;
-	std::vector<uint8_t>	data;
+	PixelBuffer				data;
 
 	// if set, we came from an 8-bit skin
 	struct {
@@ -26,7 +104,6 @@ struct Image
 		img.width = w;
 		img.height = h;
 		img.data.resize(w * h * 4);
-		memset(img.data.data(), 0, img.data.size());
 		return img;
 	}
 
@@ -55,7 +132,7 @@ struct Image
 
 	size_t data_size() const
 	{
-		return vector_element_size(data) + vector_element_size(source.data) + vector_element_size(source.palette);
+		return data.size() + vector_element_size(source.data) + vector_element_size(source.palette);
 	}
 
 	bool is_valid() const { return width != 0 && (is_rgba_valid() || is_indexed_valid()); }
@@ -95,6 +172,7 @@ struct Image
 		if (is_indexed_valid())
 		{
 			img = Image::create_indexed(width, height);
+			img.source.palette = source.palette;
 
 			const uint8_t *src = reinterpret_cast<const uint8_t *>(indexed());
 			uint8_t *dst = reinterpret_cast<uint8_t *>(img.indexed());
@@ -153,12 +231,44 @@ struct Image
 	}
 };
 
+// header-level information about an encoded image,
+// available without decoding any pixels.
+struct ImageInfo
+{
+	uint32_t	width = 0;
+	uint32_t	height = 0;
+	bool		indexed = false;
+};
+
+// a decoder for a single image format; `sniff` only gets
+// to look at the first few bytes of the file.
+struct ImageDecoder
+{
+	const char					*name;
+	bool						(*sniff)(std::span<const uint8_t> header);
+	std::optional<ImageInfo>	(*info)(std::span<const uint8_t> data);
+	Image						(*decode)(std::span<const uint8_t> data);
+};
+
 class ImageLoader
 {
 public:
 	Image Load(const std::filesystem::path &file);
 	Image Load(const std::span<const uint8_t, std::dynamic_extent> &data);
-	void Save(const Image &skin, const std::filesystem::path &file) const;
+
+	// fetch the dimensions of the image without decoding it;
+	// returns nullopt if no decoder recognizes the data.
+	std::optional<ImageInfo> Info(const std::filesystem::path &file);
+	std::optional<ImageInfo> Info(const std::span<const uint8_t, std::dynamic_extent> &data);
+
+	// find the decoder that claims the given file header.
+	const ImageDecoder *FindDecoder(const std::span<const uint8_t, std::dynamic_extent> &header) const;
+
+	// stb's default PNG compression level
+	static constexpr int PNG_DEFAULT_COMPRESSION = 8;
+
+	// pngCompressionLevel is zlib's 0-9, and only used for PNGs.
+	void Save(const Image &skin, const std::filesystem::path &file, int pngCompressionLevel = PNG_DEFAULT_COMPRESSION) const;
 
 	const std::vector<nfdfilteritem_t> &SupportedFormats()
 	{
@@ -212,4 +322,43 @@ public:
 	}
 };
 
-ImageLoader &images();
\ No newline at end of file
+ImageLoader &images();
+
+// writes a batch of images concurrently on worker threads.
+// the images are owned by the job, so the model is free to
+// change while it runs.
+class ImageExportJob
+{
+public:
+	struct Entry
+	{
+		Image					image;
+		std::filesystem::path	path;
+	};
+
+	// pngCompressionLevel is zlib's 0-9; lower is faster
+	// to write but produces larger files.
+	ImageExportJob(std::vector<Entry> entries, int pngCompressionLevel);
+	~ImageExportJob();
+
+	size_t Total() const { return _entries.size(); }
+	size_t Completed() const { return _completed; }
+	size_t Failed() const { return _failed; }
+	size_t BytesWritten() const { return _bytesWritten; }
+	size_t Threads() const { return _workers.size(); }
+	bool Finished() const { return _completed == _entries.size(); }
+
+	// wall time from start to the last file written
+	// (or until now, if still running)
+	double Seconds() const;
+
+private:
+	void Work();
+
+	std::vector<Entry>						_entries;
+	int										_pngCompressionLevel;
+	std::vector<std::thread>				_workers;
+	std::atomic_size_t						_next = 0, _completed = 0, _failed = 0, _bytesWritten = 0, _activeWorkers = 0;
+	std::chrono::steady_clock::time_point	_start;
+	std::atomic<double>						_seconds = 0;
+};
\ No newline at end of file
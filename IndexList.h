@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include "Stream.h"
+
+namespace detail
+{
+inline int32_t legacy_index_lists_i()
+{
+    static int32_t i = std::ios_base::xalloc();
+    return i;
+}
+} // namespace detail
+
+// streams written before IndexList existed (QIM version 1) stored
+// index lists as a flat std::vector<size_t> of [key, count, index...].
+// the loader flags such streams so IndexList reads the old layout.
+inline bool legacy_index_lists(std::ios_base &s)
+{
+    return s.iword(detail::legacy_index_lists_i()) != 0;
+}
+
+inline std::ios_base &set_legacy_index_lists(std::ios_base &s, bool legacy)
+{
+    s.iword(detail::legacy_index_lists_i()) = legacy ? 1 : 0;
+    return s;
+}
+
+// A compact list of sorted indices, grouped by a key (usually a
+// mesh index). Each group is stored either as varint-encoded runs
+// (gap + length) or as a bitmap over the group's span, whichever
+// encodes smaller; "select all" on a mesh costs a handful of bytes
+// instead of 8 per element.
+class IndexList
+{
+public:
+    // append a group; `indices` must be sorted and unique.
+    void add(size_t key, std::span<const size_t> indices)
+    {
+        if (indices.empty())
+            return;
+
+        size_t first = indices.front();
+        size_t span = indices.back() - first + 1;
+
+        write_varint(_data, key);
+        write_varint(_data, indices.size());
+        write_varint(_data, first);
+
+        static std::vector<uint8_t> runs;
+        runs.clear();
+
+        for (size_t i = 0, prev_end = first; i < indices.size(); )
+        {
+            size_t start = indices[i], length = 1;
+
+            while (i + length < indices.size() && indices[i + length] == start + length)
+                length++;
+
+            write_varint(runs, start - prev_end);
+            write_varint(runs, length - 1);
+            prev_end = start + length;
+            i += length;
+        }
+
+        size_t bitmap_size = varint_size(span) + ((span + 7) / 8);
+
+        if (runs.size() <= bitmap_size)
+        {
+            _data.push_back(MODE_RUNS);
+            _data.insert(_data.end(), runs.begin(), runs.end());
+        }
+        else
+        {
+            _data.push_back(MODE_BITMAP);
+            write_varint(_data, span);
+
+            size_t offset = _data.size();
+            _data.resize(offset + ((span + 7) / 8), 0);
+
+            for (auto &index : indices)
+            {
+                size_t bit = index - first;
+                _data[offset + (bit >> 3)] |= (uint8_t) (1 << (bit & 7));
+            }
+        }
+
+        _count += indices.size();
+    }
+
+    // call `func(key, index)` for every index, in insertion order
+    template<typename F>
+    void for_each(F &&func) const
+    {
+        const uint8_t *p = _data.data();
+        const uint8_t *end = p + _data.size();
+
+        while (p < end)
+        {
+            size_t key = read_varint(p);
+            size_t count = read_varint(p);
+            size_t first = read_varint(p);
+            uint8_t mode = *p++;
+
+            if (mode == MODE_RUNS)
+            {
+                for (size_t prev_end = first; count; )
+                {
+                    size_t start = prev_end + read_varint(p);
+                    size_t length = read_varint(p) + 1;
+
+                    for (size_t i = 0; i < length; i++)
+                        func(key, start + i);
+
+                    prev_end = start + length;
+                    count -= length;
+                }
+            }
+            else
+            {
+                size_t span = read_varint(p);
+
+                for (size_t bit = 0; bit < span; bit++)
+                    if (p[bit >> 3] & (1 << (bit & 7)))
+                        func(key, first + bit);
+
+                p += (span + 7) / 8;
+            }
+        }
+    }
+
+    bool operator==(const IndexList &) const = default;
+
+    constexpr bool empty() const { return !_count; }
+    constexpr size_t size() const { return _count; }
+
+    // heap memory used by the encoded data
+    constexpr size_t memory_size() const { return _data.capacity(); }
+
+    void shrink_to_fit() { _data.shrink_to_fit(); }
+
+    void stream_write(std::ostream &s) const
+    {
+        s <= _count <= _data.size();
+        s.write((const char *) _data.data(), _data.size());
+    }
+
+    void stream_read(std::istream &s)
+    {
+        if (legacy_index_lists(s))
+        {
+            stream_read_legacy(s, nullptr);
+            return;
+        }
+
+        size_t bytes;
+        s >= _count >= bytes;
+        _data.resize(bytes);
+        s.read((char *) _data.data(), bytes);
+    }
+
+    // read the old [key, count, index...] layout. old lists weren't
+    // always sorted, so if `order` is set it receives, for each index
+    // in for_each order, its position in the old list; values stored
+    // alongside the list can then be put back in step with reorder().
+    void stream_read_legacy(std::istream &s, std::vector<size_t> *order)
+    {
+        std::vector<size_t> flat, sorted, group_order;
+        s >= flat;
+
+        *this = {};
+
+        if (order)
+            order->clear();
+
+        for (size_t i = 0, position = 0; i + 1 < flat.size(); )
+        {
+            size_t key = flat[i];
+            size_t count = std::min(flat[i + 1], flat.size() - (i + 2));
+            i += 2;
+
+            group_order.resize(count);
+            std::iota(group_order.begin(), group_order.end(), (size_t) 0);
+            std::sort(group_order.begin(), group_order.end(), [&](size_t a, size_t b) { return flat[i + a] < flat[i + b]; });
+
+            sorted.clear();
+
+            for (auto &o : group_order)
+                sorted.push_back(flat[i + o]);
+
+            add(key, sorted);
+
+            if (order)
+                for (auto &o : group_order)
+                    order->push_back(position + o);
+
+            i += count;
+            position += count;
+        }
+    }
+
+    // permute `values` (stored in old list order) to for_each order
+    template<typename T>
+    static void reorder(std::vector<T> &values, const std::vector<size_t> &order)
+    {
+        std::vector<T> reordered;
+        reordered.reserve(order.size());
+
+        for (auto &o : order)
+            reordered.push_back(values[o]);
+
+        values = std::move(reordered);
+    }
+
+private:
+    enum : uint8_t
+    {
+        MODE_RUNS,
+        MODE_BITMAP
+    };
+
+    std::vector<uint8_t> _data;
+    size_t               _count = 0;
+
+    static void write_varint(std::vector<uint8_t> &out, size_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back((uint8_t) (value | 0x80));
+            value >>= 7;
+        }
+
+        out.push_back((uint8_t) value);
+    }
+
+    static size_t read_varint(const uint8_t *&p)
+    {
+        size_t value = 0;
+
+        for (int shift = 0; ; shift += 7)
+        {
+            uint8_t b = *p++;
+            value |= (size_t) (b & 0x7F) << shift;
+
+            if (!(b & 0x80))
+                break;
+        }
+
+        return value;
+    }
+
+    static constexpr size_t varint_size(size_t value)
+    {
+        size_t n = 1;
+
+        for (; value >= 0x80; value >>= 7)
+            n++;
+
+        return n;
+    }
+};
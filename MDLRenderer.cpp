@@ -27,67 +27,291 @@ struct GPUAxisData
     Color       color;
 };
 
-// handles lifecycle for model skins
+// texture unit the palette of an indexed skin lives in
+static constexpr GLuint PALETTE_TEXTURE_UNIT = 1;
+
+// handles lifecycle for model skins. indexed skins stay
+// indexed on the GPU: the index plane is an R8 texture, and
+// the palette a 256x1 RGBA one resolved in model.frag.glsl.
 struct MDLSkinDataHandle : public RendererSkinHandle
 {
-    MDLSkinDataHandle(ModelSkin &skin)
+    // number of pixel unpack buffers we cycle through; by the
+    // time we wrap back around to one, the driver is usually
+    // done pulling from it, which its fence confirms.
+    static constexpr size_t PBO_RING_SIZE = 3;
+    // how long to wait on a slot's fence before letting
+    // the driver synchronize the map instead, in ns
+    static constexpr GLuint64 PBO_FENCE_TIMEOUT = 100'000'000;
+
+    MDLSkinDataHandle(ModelSkin &skin) :
+        _width(skin.width),
+        _height(skin.height),
+        _paletted(skin.image.is_indexed_valid()),
+        _revision(++_revisionCounter)
     {
         glGenTextures(1, &_id);
 
-        Bind();
-
-        if (skin.image.is_indexed_valid())
-            skin.image.convert_to_rgba();
+        glBindTexture(GL_TEXTURE_2D, _id);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, skin.width, skin.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, skin.image.rgba());
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        if (_paletted)
+        {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, skin.width, skin.height, 0, GL_RED, GL_UNSIGNED_BYTE, skin.image.indexed());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            // indices can't be mipmapped; this keeps the texture
+            // complete under the filtered sampler.
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+            glGenTextures(1, &_paletteId);
+            glBindTexture(GL_TEXTURE_2D, _paletteId);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            UploadPalette(skin);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, skin.width, skin.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, skin.image.rgba());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
     }
 
     virtual ~MDLSkinDataHandle() override
     {
+        for (auto &fence : _fences)
+            if (fence)
+                glDeleteSync(fence);
+
+        if (_pbos[0])
+            glDeleteBuffers(PBO_RING_SIZE, _pbos.data());
+
+        if (_paletteId)
+            glDeleteTextures(1, &_paletteId);
+
+        if (_displayId)
+            glDeleteTextures(1, &_displayId);
+
         if (!_id)
             return;
 
         glDeleteTextures(1, &_id);
     }
 
-    virtual void MarkDirty() override
+    virtual void MarkDirty(std::optional<SkinRect> rect) override
     {
-        _dirty = true;
+        SkinRect full { 0, 0, _width, _height };
+
+        _revision = ++_revisionCounter;
+        _displayDirty = true;
+
+        if (!rect)
+            _dirty = full;
+        else if (_dirty)
+            _dirty = _dirty->merged(*rect);
+        else
+            _dirty = rect;
+    }
+
+    virtual void MarkPaletteDirty() override
+    {
+        _revision = ++_revisionCounter;
+        _displayDirty = true;
+        _paletteDirty = true;
     }
 
     virtual void Update(ModelSkin &skin) override
     {
+        if (_paletteDirty)
+        {
+            UploadPalette(skin);
+            _paletteDirty = false;
+        }
+
         if (!_dirty)
             return;
 
-        Bind();
+        // clip to the texture
+        SkinRect rect = *_dirty;
+
+        int32_t x1 = std::min(rect.x + rect.w, _width), y1 = std::min(rect.y + rect.h, _height);
+        rect.x = std::max(rect.x, 0);
+        rect.y = std::max(rect.y, 0);
+        rect.w = x1 - rect.x;
+        rect.h = y1 - rect.y;
+
+        // nothing that can be uploaded
+        if (rect.w <= 0 || rect.h <= 0 || (_paletted ? !skin.image.is_indexed_valid() : !skin.image.is_rgba_valid()))
+        {
+            _dirty.reset();
+            return;
+        }
+
+        if (!_pbos[0])
+            glGenBuffers(PBO_RING_SIZE, _pbos.data());
+
+        size_t pbo = _pboIndex;
+        _pboIndex = (_pboIndex + 1) % PBO_RING_SIZE;
+
+        // rows are packed tightly into the PBO, so only the
+        // touched texels ever leave the CPU.
+        size_t texelSize = _paletted ? 1 : 4;
+        size_t rowSize = rect.w * texelSize;
+        size_t uploadSize = rowSize * rect.h;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[pbo]);
+
+        // storage only grows; after the first few uploads the
+        // ring is just re-mapped.
+        if (uploadSize > _pboSizes[pbo])
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, uploadSize, nullptr, GL_STREAM_DRAW);
+            _pboSizes[pbo] = uploadSize;
+        }
+
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+
+        // the GPU may still be pulling from this slot; only skip
+        // the driver's own synchronization once its fence is done.
+        if (_fences[pbo])
+        {
+            GLenum wait = glClientWaitSync(_fences[pbo], GL_SYNC_FLUSH_COMMANDS_BIT, PBO_FENCE_TIMEOUT);
+            glDeleteSync(_fences[pbo]);
+            _fences[pbo] = nullptr;
+
+            if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED)
+                access |= GL_MAP_UNSYNCHRONIZED_BIT;
+        }
+        else
+            access |= GL_MAP_UNSYNCHRONIZED_BIT;
+
+        // if mapping fails, the region stays dirty for next time
+        if (auto dst = reinterpret_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, uploadSize, access)))
+        {
+            const uint8_t *src = (_paletted ? skin.image.indexed() : skin.image.rgba()) + ((rect.y * skin.image.width) + rect.x) * texelSize;
+
+            for (int32_t y = 0; y < rect.h; y++, dst += rowSize, src += skin.image.width * texelSize)
+                memcpy(dst, src, rowSize);
+
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            glBindTexture(GL_TEXTURE_2D, _id);
+
+            if (_paletted)
+            {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
+            else
+            {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+
+            _fences[pbo] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            _dirty.reset();
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // ImGui can't resolve palettes, so indexed skins that
+    // get displayed in the UI need an RGBA copy; this is only
+    // built for skins that ask for it.
+    void UpdateDisplay(ModelSkin &skin)
+    {
+        if (!_paletted || (_displayId && !_displayDirty))
+            return;
+
+        _displayDirty = false;
 
-        if (skin.image.is_indexed_valid())
-            skin.image.convert_to_rgba();
+        if (!_displayId)
+        {
+            glGenTextures(1, &_displayId);
+            glBindTexture(GL_TEXTURE_2D, _displayId);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        }
+        else
+            glBindTexture(GL_TEXTURE_2D, _displayId);
+
+        // the texture is _width x _height; the image may have
+        // been resized since, so only the overlap is copied.
+        auto palette = ResolvePalette(skin);
+        std::vector<Color> pixels((size_t) _width * _height, Color(0, 0, 0, 0));
+        int32_t w = std::min(_width, (int32_t) skin.image.width), h = std::min(_height, (int32_t) skin.image.height);
 
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, skin.width, skin.height, GL_RGBA, GL_UNSIGNED_BYTE, skin.image.rgba());
-        glGenerateMipmap(GL_TEXTURE_2D);
-        _dirty = false;
+        if (skin.image.indexed_size() < (size_t) skin.image.width * skin.image.height)
+            w = h = 0;
+
+        for (int32_t y = 0; y < h; y++)
+            for (int32_t x = 0; x < w; x++)
+                pixels[y * _width + x] = palette[skin.image.indexed()[y * skin.image.width + x]];
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
     }
 
     virtual void Bind() const override
     {
+        if (_paletted)
+        {
+            glActiveTexture(GL_TEXTURE0 + PALETTE_TEXTURE_UNIT);
+            glBindTexture(GL_TEXTURE_2D, _paletteId);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
         glBindTexture(GL_TEXTURE_2D, _id);
     }
 
     virtual ImTextureID GetTextureHandle() const override
     {
-        return (ImTextureID) (ptrdiff_t) _id;
+        return (ImTextureID) (ptrdiff_t) (_paletted ? _displayId : _id);
+    }
+
+    virtual uint64_t GetRevision() const override
+    {
+        return _revision;
     }
 
+    bool IsPaletted() const { return _paletted; }
+
 private:
-    GLuint  _id = 0;
-    bool    _dirty = false;
+    static inline uint64_t                  _revisionCounter = 0;
+
+    GLuint                                  _id = 0, _paletteId = 0, _displayId = 0;
+    int32_t                                 _width, _height;
+    bool                                    _paletted;
+    bool                                    _paletteDirty = false, _displayDirty = true;
+    uint64_t                                _revision;
+    std::optional<SkinRect>                 _dirty;
+    std::array<GLuint, PBO_RING_SIZE>       _pbos {};
+    std::array<size_t, PBO_RING_SIZE>       _pboSizes {};
+    std::array<GLsync, PBO_RING_SIZE>       _fences {};
+    size_t                                  _pboIndex = 0;
+
+    // RGB palette -> RGBA, matching Image::convert_to_rgba
+    static std::array<Color, 256> ResolvePalette(const ModelSkin &skin)
+    {
+        std::array<Color, 256> colors;
+        const uint8_t *pal = skin.image.palette();
+
+        for (size_t i = 0; i < colors.size(); i++)
+            colors[i] = Color(pal[i * 3 + 0], pal[i * 3 + 1], pal[i * 3 + 2], i == 255 ? 0 : 255);
+
+        return colors;
+    }
+
+    void UploadPalette(const ModelSkin &skin)
+    {
+        auto colors = ResolvePalette(skin);
+        glBindTexture(GL_TEXTURE_2D, _paletteId);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, colors.data());
+    }
 };
 
 MDLRenderer::MDLRenderer()
@@ -352,6 +576,9 @@ void MDLRenderer::initializeGL()
     _modelProgram.modelviewUniformLocation = glGetUniformLocation(_modelProgram.program, "u_modelview");
 
     glUniform1i(glGetUniformLocation(_modelProgram.program, "u_texture"), 0);
+    glUniform1i(glGetUniformLocation(_modelProgram.program, "u_palette"), PALETTE_TEXTURE_UNIT);
+    _modelProgram.palettedLocation = glGetUniformLocation(_modelProgram.program, "u_paletted");
+    _modelProgram.filteredLocation = glGetUniformLocation(_modelProgram.program, "u_filtered");
     glUniform1i(_modelProgram.shadedUniformLocation = glGetUniformLocation(_modelProgram.program, "u_shaded"), 1);
     _modelProgram.is2DLocation = glGetUniformLocation(_modelProgram.program, "u_2d");
     _modelProgram.isLineLocation = glGetUniformLocation(_modelProgram.program, "u_line");
@@ -636,8 +863,15 @@ void MDLRenderer::mouseReleaseEvent(ImVec2 localPos)
         {
             glm::mat4 drag = getDragMatrix();
 
+            auto &range = ui().editor3D().frameRange();
+
             if (!glm::all(glm::equal(drag, glm::identity<glm::mat4>())))
-                model().mutator().apply3DMatrix(drag, ui().editor3D().editorSelectMode());
+            {
+                if (range.active)
+                    model().mutator().apply3DMatrix(drag, ui().editor3D().editorSelectMode(), range.from, range.to);
+                else
+                    model().mutator().apply3DMatrix(drag, ui().editor3D().editorSelectMode());
+            }
         }
     }
 
@@ -963,11 +1197,13 @@ void MDLRenderer::drawModels(QuadrantFocus quadrant, bool is_2d)
     if (params.filtered)
         glBindSampler(0, _filteredSampler);
 
+    glUniform1i(_modelProgram.filteredLocation, params.filtered);
     glUniform1i(_modelProgram.isLineLocation, (params.mode == RenderMode::Wireframe) ? 1 : (params.mode != RenderMode::Wireframe && params.showOverlay) ? 2 : 0);
 
     for (auto &mesh : model().model().meshes)
     {
         GLsizei count = mesh.triangles.size() * 3;
+        bool paletted = false;
 
         if (params.mode == RenderMode::Textured)
         {
@@ -977,8 +1213,14 @@ void MDLRenderer::drawModels(QuadrantFocus quadrant, bool is_2d)
                 skin = model().model().selectedSkin;
 
             if (skin)
-                model().model().skins[skin.value()].handle->Bind();
+            {
+                auto handle = static_cast<MDLSkinDataHandle *>(model().model().skins[skin.value()].handle.get());
+                handle->Bind();
+                paletted = handle->IsPaletted();
+            }
         }
+
+        glUniform1i(_modelProgram.palettedLocation, paletted);
         
         glDrawArrays(GL_TRIANGLES, offset, count);
         offset += count;
@@ -1156,6 +1398,84 @@ void MDLRenderer::updateTextures()
 
         static_cast<MDLSkinDataHandle *>(skin.handle.get())->Update(skin);
     }
+
+    if (auto skin = model().mutator().data->getSelectedSkin())
+        static_cast<MDLSkinDataHandle *>(skin->handle.get())->UpdateDisplay(*skin);
+
+    _skinThumbnails.update(model().mutator().data->skins);
+}
+
+SkinThumbnailAtlas::~SkinThumbnailAtlas()
+{
+    if (_texture)
+        glDeleteTextures(1, &_texture);
+}
+
+void SkinThumbnailAtlas::update(std::vector<ModelSkin> &skins)
+{
+    int rows = std::max(1, (int) (skins.size() + COLUMNS - 1) / COLUMNS);
+
+    if (!_texture)
+        glGenTextures(1, &_texture);
+
+    glBindTexture(GL_TEXTURE_2D, _texture);
+
+    // grow the atlas; the new storage is blank,
+    // so every cell has to be redrawn.
+    if (rows > _rows)
+    {
+        _rows = rows;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, COLUMNS * CELL_SIZE, _rows * CELL_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        _cells.clear();
+    }
+
+    _cells.resize(skins.size());
+
+    for (size_t i = 0; i < skins.size(); i++)
+    {
+        auto &skin = skins[i];
+        auto &cell = _cells[i];
+
+        if (!skin.handle || cell.revision == skin.handle->GetRevision())
+            continue;
+
+        cell.revision = skin.handle->GetRevision();
+
+        if (!skin.image.is_valid())
+        {
+            cell.width = cell.height = 0;
+            continue;
+        }
+
+        // fit into the cell, keeping aspect
+        float scale = std::min((float) CELL_SIZE / skin.image.width, (float) CELL_SIZE / skin.image.height);
+        cell.width = std::clamp((int) (skin.image.width * scale), 1, CELL_SIZE);
+        cell.height = std::clamp((int) (skin.image.height * scale), 1, CELL_SIZE);
+
+        Image thumb = skin.image.resized(cell.width, cell.height, true);
+
+        if (!thumb.is_rgba_valid())
+            thumb.convert_to_rgba();
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (i % COLUMNS) * CELL_SIZE, (i / COLUMNS) * CELL_SIZE, cell.width, cell.height, GL_RGBA, GL_UNSIGNED_BYTE, thumb.rgba());
+    }
+}
+
+std::optional<SkinThumbnail> SkinThumbnailAtlas::thumbnail(size_t skin) const
+{
+    if (skin >= _cells.size() || !_cells[skin].width)
+        return std::nullopt;
+
+    auto &cell = _cells[skin];
+    ImVec2 texSize { (float) (COLUMNS * CELL_SIZE), (float) (_rows * CELL_SIZE) };
+    ImVec2 uv0 { ((skin % COLUMNS) * CELL_SIZE) / texSize.x, ((skin / COLUMNS) * CELL_SIZE) / texSize.y };
+    ImVec2 uv1 { uv0.x + (cell.width / texSize.x), uv0.y + (cell.height / texSize.y) };
+
+    return SkinThumbnail { (ImTextureID) (ptrdiff_t) _texture, uv0, uv1, { (float) cell.width, (float) cell.height } };
 }
 
 void MDLRenderer::paint()
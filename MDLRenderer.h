@@ -86,7 +86,9 @@ struct ProgramShared
           face3DLocation,
           face2DLocation,
           line3DLocation,
-          line2DLocation;
+          line2DLocation,
+          palettedLocation,
+          filteredLocation;
 };
 
 struct QuadrantMatrices
@@ -95,6 +97,43 @@ struct QuadrantMatrices
     Matrix4 modelview;
 };
 
+// a single skin's spot in the thumbnail atlas
+struct SkinThumbnail
+{
+    ImTextureID texture;
+    ImVec2      uv0, uv1;
+    ImVec2      size; // in pixels; aspect-correct, fits in a cell
+};
+
+// downsampled copies of every skin packed into one shared
+// texture, for UI that shows many skins at once. cells are
+// only redrawn when their skin's revision changes.
+class SkinThumbnailAtlas
+{
+public:
+    static constexpr int CELL_SIZE = 64;
+    static constexpr int COLUMNS = 8;
+
+    SkinThumbnailAtlas() = default;
+    SkinThumbnailAtlas(const SkinThumbnailAtlas &) = delete;
+    SkinThumbnailAtlas &operator=(const SkinThumbnailAtlas &) = delete;
+    ~SkinThumbnailAtlas();
+
+    void update(std::vector<ModelSkin> &skins);
+    std::optional<SkinThumbnail> thumbnail(size_t skin) const;
+
+private:
+    struct Cell
+    {
+        uint64_t    revision = 0;
+        int         width = 0, height = 0;
+    };
+
+    GLuint              _texture = 0;
+    int                 _rows = 0;
+    std::vector<Cell>   _cells;
+};
+
 class MDLRenderer
 {
 #ifdef RENDERDOC_SUPPORT
@@ -130,6 +169,7 @@ public:
 
     void paint();
     void updateTextures();
+    const SkinThumbnailAtlas &skinThumbnails() const { return _skinThumbnails; }
 
     GLuint getRendererTexture();
 
@@ -173,6 +213,7 @@ private:
 
     GLuint _buffer = 0, _pointBuffer = 0, _smoothNormalBuffer = 0, _flatNormalBuffer = 0, _axisBuffer = 0, _gridBuffer = 0, _normalsBuffer = 0;
     GLuint _whiteTexture = 0, _blackTexture = 0;
+    SkinThumbnailAtlas _skinThumbnails;
     size_t _gridSize = 0;
     GLuint _uboIndex = 0, _uboObject = 0;
     GPURenderData _uboData;
@@ -0,0 +1,930 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+
+#include "MeshTools.h"
+#include "Parallel.h"
+#include "Settings.h"
+#include "Log.h"
+
+size_t RemapMesh(ModelMesh &mesh, const std::vector<uint32_t> &vertexRemap, size_t numVertices,
+                 const std::vector<uint32_t> &texcoordRemap, size_t numTexcoords)
+{
+    // the first source of each slot, for frame data
+    std::vector<uint32_t> sources(numVertices, REMAP_DROPPED);
+    std::vector<ModelVertex> vertices(numVertices);
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        uint32_t to = vertexRemap[i];
+
+        if (to == REMAP_DROPPED)
+            continue;
+
+        if (sources[to] == REMAP_DROPPED)
+            sources[to] = (uint32_t) i;
+
+        vertices[to].selected = vertices[to].selected || mesh.vertices[i].selected;
+    }
+
+    parallel_for(mesh.frames.size(), [&](size_t f) {
+        auto &frame = mesh.frames[f];
+        std::vector<MeshFrameVertTag> remapped(numVertices);
+
+        for (size_t i = 0; i < numVertices; i++)
+            remapped[i] = frame.vertices[sources[i]];
+
+        frame.vertices = std::move(remapped);
+    });
+
+    mesh.vertices = std::move(vertices);
+
+    std::vector<ModelTexCoord> texcoords(numTexcoords);
+    sources.assign(numTexcoords, REMAP_DROPPED);
+
+    for (size_t i = 0; i < mesh.texcoords.size(); i++)
+    {
+        uint32_t to = texcoordRemap[i];
+
+        if (to == REMAP_DROPPED)
+            continue;
+
+        if (sources[to] == REMAP_DROPPED)
+        {
+            sources[to] = (uint32_t) i;
+            texcoords[to].pos = mesh.texcoords[i].pos;
+        }
+
+        texcoords[to].selected = texcoords[to].selected || mesh.texcoords[i].selected;
+    }
+
+    mesh.texcoords = std::move(texcoords);
+
+    for (auto &tri : mesh.triangles)
+        for (size_t i = 0; i < 3; i++)
+        {
+            tri.vertices[i] = vertexRemap[tri.vertices[i]];
+            tri.texcoords[i] = texcoordRemap[tri.texcoords[i]];
+        }
+
+    return std::erase_if(mesh.triangles, [](const ModelTriangle &tri) {
+        for (size_t i = 0; i < 3; i++)
+            if (tri.vertices[i] == REMAP_DROPPED || tri.texcoords[i] == REMAP_DROPPED)
+                return true;
+
+        return tri.vertices[0] == tri.vertices[1] || tri.vertices[1] == tri.vertices[2] || tri.vertices[0] == tri.vertices[2];
+    });
+}
+
+
+MeshCompactResult CompactMesh(ModelMesh &mesh)
+{
+    MeshCompactResult result;
+
+    result.triangles = std::erase_if(mesh.triangles, [&](const ModelTriangle &tri) {
+        for (size_t i = 0; i < 3; i++)
+            if (tri.vertices[i] >= mesh.vertices.size() || tri.texcoords[i] >= mesh.texcoords.size())
+                return true;
+
+        return tri.vertices[0] == tri.vertices[1] || tri.vertices[1] == tri.vertices[2] || tri.vertices[0] == tri.vertices[2];
+    });
+
+    std::vector<uint32_t> vertexRemap(mesh.vertices.size(), REMAP_DROPPED);
+    std::vector<uint32_t> texcoordRemap(mesh.texcoords.size(), REMAP_DROPPED);
+
+    for (auto &tri : mesh.triangles)
+        for (size_t i = 0; i < 3; i++)
+        {
+            vertexRemap[tri.vertices[i]] = 0;
+            texcoordRemap[tri.texcoords[i]] = 0;
+        }
+
+    if (!mesh.frames.empty())
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            if (mesh.frames[0].vertices[i].is_tag())
+                vertexRemap[i] = 0;
+
+    // number the survivors in their original order
+    size_t numVertices = 0, numTexcoords = 0;
+
+    for (auto &to : vertexRemap)
+        if (to != REMAP_DROPPED)
+            to = (uint32_t) numVertices++;
+
+    for (auto &to : texcoordRemap)
+        if (to != REMAP_DROPPED)
+            to = (uint32_t) numTexcoords++;
+
+    result.vertices = mesh.vertices.size() - numVertices;
+    result.texcoords = mesh.texcoords.size() - numTexcoords;
+
+    if (result.vertices || result.texcoords)
+        RemapMesh(mesh, vertexRemap, numVertices, texcoordRemap, numTexcoords);
+
+    return result;
+}
+
+size_t VertexCacheMisses(const ModelMesh &mesh, size_t cacheSize)
+{
+    std::vector<uint32_t> cache;
+    cache.reserve(cacheSize);
+    size_t misses = 0, next = 0;
+
+    for (auto &tri : mesh.triangles)
+        for (auto &v : tri.vertices)
+        {
+            if (std::find(cache.begin(), cache.end(), v) != cache.end())
+                continue;
+
+            misses++;
+
+            // FIFO; overwrite the oldest entry once full
+            if (cache.size() < cacheSize)
+                cache.push_back(v);
+            else
+            {
+                cache[next] = v;
+                next = (next + 1) % cacheSize;
+            }
+        }
+
+    return misses;
+}
+
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw",
+// Sander, Nehab & Barczak, 2007. fans around one vertex at a time,
+// moving on to whichever neighbor is most likely still in the cache.
+static std::vector<uint32_t> TipsifyOrder(const ModelMesh &mesh, size_t cacheSize)
+{
+    const size_t numVertices = mesh.vertices.size();
+    const size_t numTriangles = mesh.triangles.size();
+
+    // vertex -> triangles, as offsets into one array
+    std::vector<uint32_t> offsets(numVertices + 1, 0), adjacency(numTriangles * 3);
+
+    for (auto &tri : mesh.triangles)
+        for (auto &v : tri.vertices)
+            offsets[v + 1]++;
+
+    for (size_t i = 0; i < numVertices; i++)
+        offsets[i + 1] += offsets[i];
+
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+        for (uint32_t t = 0; t < numTriangles; t++)
+            for (auto &v : mesh.triangles[t].vertices)
+                adjacency[fill[v]++] = t;
+    }
+
+    // live triangle count and cache timestamp per vertex
+    std::vector<uint32_t> live(numVertices);
+    std::vector<size_t> timestamps(numVertices, 0);
+    std::vector<uint8_t> emitted(numTriangles, 0);
+    std::vector<uint32_t> deadEnd, candidates, order;
+
+    for (size_t i = 0; i < numVertices; i++)
+        live[i] = offsets[i + 1] - offsets[i];
+
+    order.reserve(numTriangles);
+    size_t time = cacheSize + 1, cursor = 0;
+    int64_t fanning = numTriangles ? 0 : -1;
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; i++)
+        {
+            uint32_t t = adjacency[i];
+
+            if (emitted[t])
+                continue;
+
+            for (auto &v : mesh.triangles[t].vertices)
+            {
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+
+                if (time - timestamps[v] > cacheSize)
+                    timestamps[v] = time++;
+            }
+
+            emitted[t] = 1;
+            order.push_back(t);
+        }
+
+        // pick the candidate that will still be in the cache
+        // once its remaining triangles are emitted
+        fanning = -1;
+        int64_t best = -1;
+
+        for (auto &v : candidates)
+        {
+            if (!live[v])
+                continue;
+
+            int64_t priority = 0;
+
+            if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+                priority = time - timestamps[v];
+
+            if (priority > best)
+            {
+                best = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning >= 0)
+            continue;
+
+        // dead end; back up through recently used vertices,
+        // then fall back to scanning for any live one
+        while (!deadEnd.empty())
+        {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+
+            if (live[v])
+            {
+                fanning = v;
+                break;
+            }
+        }
+
+        for (; fanning < 0 && cursor < numVertices; cursor++)
+            if (live[cursor])
+                fanning = cursor;
+    }
+
+    return order;
+}
+
+void OptimizeVertexCache(ModelMesh &mesh, size_t cacheSize)
+{
+    if (mesh.triangles.empty())
+        return;
+
+    auto order = TipsifyOrder(mesh, cacheSize);
+
+    std::vector<ModelTriangle> triangles;
+    triangles.reserve(order.size());
+
+    for (auto &t : order)
+        triangles.push_back(mesh.triangles[t]);
+
+    mesh.triangles = std::move(triangles);
+
+    // number vertices and texcoords by first use
+    std::vector<uint32_t> vertexRemap(mesh.vertices.size(), REMAP_DROPPED);
+    std::vector<uint32_t> texcoordRemap(mesh.texcoords.size(), REMAP_DROPPED);
+    size_t numVertices = 0, numTexcoords = 0;
+
+    for (auto &tri : mesh.triangles)
+        for (size_t i = 0; i < 3; i++)
+        {
+            if (vertexRemap[tri.vertices[i]] == REMAP_DROPPED)
+                vertexRemap[tri.vertices[i]] = (uint32_t) numVertices++;
+            if (texcoordRemap[tri.texcoords[i]] == REMAP_DROPPED)
+                texcoordRemap[tri.texcoords[i]] = (uint32_t) numTexcoords++;
+        }
+
+    for (auto &to : vertexRemap)
+        if (to == REMAP_DROPPED)
+            to = (uint32_t) numVertices++;
+
+    for (auto &to : texcoordRemap)
+        if (to == REMAP_DROPPED)
+            to = (uint32_t) numTexcoords++;
+
+    RemapMesh(mesh, vertexRemap, numVertices, texcoordRemap, numTexcoords);
+}
+
+// directed edge between two corners, (vertex, texcoord) each
+using MeshEdge = std::array<uint32_t, 4>;
+
+struct MeshEdgeHash
+{
+    size_t operator()(const MeshEdge &e) const
+    {
+        uint64_t h = 0;
+
+        for (auto &v : e)
+            h = (h ^ v) * 0x100000001B3ull;
+
+        return (size_t) h;
+    }
+};
+
+std::vector<MeshPrimitive> BuildStripsAndFans(const ModelMesh &mesh)
+{
+    using Corner = std::array<uint32_t, 2>;
+
+    auto corner = [&](uint32_t t, size_t k) -> Corner {
+        auto &tri = mesh.triangles[t];
+        return { tri.vertices[k % 3], tri.texcoords[k % 3] };
+    };
+
+    // edge k -> k + 1 of every triangle
+    std::unordered_multimap<MeshEdge, std::pair<uint32_t, uint8_t>, MeshEdgeHash> edges;
+    edges.reserve(mesh.triangles.size() * 3);
+
+    for (uint32_t t = 0; t < mesh.triangles.size(); t++)
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            Corner a = corner(t, k), b = corner(t, k + 1);
+            edges.emplace(MeshEdge { a[0], a[1], b[0], b[1] }, std::make_pair(t, k));
+        }
+
+    // 0 = free, 1 = used, 2 = in the strip/fan being measured
+    std::vector<uint8_t> marks(mesh.triangles.size(), 0);
+
+    // triangle (and the index of `a` in it) that has the edge a -> b
+    auto find = [&](const Corner &a, const Corner &b) -> std::optional<std::pair<uint32_t, uint8_t>> {
+        auto [first, last] = edges.equal_range(MeshEdge { a[0], a[1], b[0], b[1] });
+
+        for (auto it = first; it != last; it++)
+            if (!marks[it->second.first])
+                return it->second;
+
+        return std::nullopt;
+    };
+
+    std::vector<MeshPrimitive> primitives;
+    MeshPrimitive current, best;
+    std::vector<uint32_t> currentTris, bestTris;
+
+    for (uint32_t t = 0; t < mesh.triangles.size(); t++)
+    {
+        if (marks[t])
+            continue;
+
+        bestTris.clear();
+
+        for (bool fan : { false, true })
+            for (size_t start = 0; start < 3; start++)
+            {
+                current.fan = fan;
+                current.corners = { corner(t, start), corner(t, start + 1), corner(t, start + 2) };
+                currentTris = { t };
+                marks[t] = 2;
+
+                // strips alternate which of the last two corners the
+                // next triangle shares; fans always keep the first.
+                Corner m1 = fan ? corner(t, start) : corner(t, start + 2);
+                Corner m2 = fan ? corner(t, start + 2) : corner(t, start + 1);
+
+                while (auto next = find(m1, m2))
+                {
+                    auto [j, k] = *next;
+                    Corner third = corner(j, k + 2);
+
+                    if (fan || (currentTris.size() & 1))
+                        m2 = third;
+                    else
+                        m1 = third;
+
+                    current.corners.push_back(third);
+                    currentTris.push_back(j);
+                    marks[j] = 2;
+                }
+
+                for (auto &j : currentTris)
+                    marks[j] = 0;
+
+                if (currentTris.size() > bestTris.size())
+                {
+                    std::swap(best, current);
+                    std::swap(bestTris, currentTris);
+                }
+            }
+
+        for (auto &j : bestTris)
+            marks[j] = 1;
+
+        primitives.push_back(std::move(best));
+    }
+
+    return primitives;
+}
+
+void RecomputeNormals(ModelMesh &mesh, std::optional<float> creaseAngle)
+{
+    float creaseCos = creaseAngle ? std::cos(*creaseAngle) : -1.0f;
+
+    parallel_for(mesh.frames.size(), [&](size_t f) {
+        auto &vertices = mesh.frames[f].vertices;
+
+        // unnormalized face normals; their length is twice
+        // the area, which weights the sums below.
+        std::vector<glm::vec3> faces(mesh.triangles.size());
+
+        for (size_t t = 0; t < mesh.triangles.size(); t++)
+        {
+            auto &tri = mesh.triangles[t];
+            const glm::vec3 &p0 = vertices[tri.vertices[0]].position();
+            faces[t] = glm::cross(vertices[tri.vertices[1]].position() - p0, vertices[tri.vertices[2]].position() - p0);
+        }
+
+        // with a crease, find each vertex's largest triangle first
+        std::vector<glm::vec3> dominant;
+
+        if (creaseAngle)
+        {
+            dominant.resize(vertices.size(), glm::vec3(0));
+
+            for (size_t t = 0; t < mesh.triangles.size(); t++)
+                for (auto &v : mesh.triangles[t].vertices)
+                    if (glm::dot(faces[t], faces[t]) > glm::dot(dominant[v], dominant[v]))
+                        dominant[v] = faces[t];
+
+            for (auto &d : dominant)
+                if (d != glm::vec3(0))
+                    d = glm::normalize(d);
+        }
+
+        std::vector<glm::vec3> sums(vertices.size(), glm::vec3(0));
+
+        for (size_t t = 0; t < mesh.triangles.size(); t++)
+        {
+            glm::vec3 face = faces[t];
+
+            if (face == glm::vec3(0))
+                continue;
+
+            for (auto &v : mesh.triangles[t].vertices)
+            {
+                if (creaseAngle && glm::dot(glm::normalize(face), dominant[v]) < creaseCos)
+                    continue;
+
+                sums[v] += face;
+            }
+        }
+
+        // unused vertices and tags keep what they had
+        for (size_t i = 0; i < vertices.size(); i++)
+            if (vertices[i].is_vertex() && sums[i] != glm::vec3(0))
+                vertices[i].vertex().normal = glm::normalize(sums[i]);
+    });
+}
+
+// sum of squared distances to a set of planes, as the
+// upper half of a symmetric 4x4 matrix
+struct Quadric
+{
+    std::array<double, 10> q {};
+
+    static Quadric plane(const glm::dvec3 &n, double d, double weight)
+    {
+        return { {
+            weight * n.x * n.x, weight * n.x * n.y, weight * n.x * n.z, weight * n.x * d,
+                                weight * n.y * n.y, weight * n.y * n.z, weight * n.y * d,
+                                                    weight * n.z * n.z, weight * n.z * d,
+                                                                        weight * d * d
+        } };
+    }
+
+    Quadric &operator+=(const Quadric &other)
+    {
+        for (size_t i = 0; i < q.size(); i++)
+            q[i] += other.q[i];
+
+        return *this;
+    }
+
+    double error(const glm::dvec3 &p) const
+    {
+        return q[0] * p.x * p.x + 2 * q[1] * p.x * p.y + 2 * q[2] * p.x * p.z + 2 * q[3] * p.x
+                                +     q[4] * p.y * p.y + 2 * q[5] * p.y * p.z + 2 * q[6] * p.y
+                                                       +     q[7] * p.z * p.z + 2 * q[8] * p.z
+                                                                              +     q[9];
+    }
+};
+
+void DecimateMesh(ModelMesh &mesh, size_t targetTriangles)
+{
+    const size_t numVertices = mesh.vertices.size();
+    const size_t numFrames = mesh.frames.size();
+    size_t liveTriangles = mesh.triangles.size();
+
+    if (liveTriangles <= targetTriangles || !numFrames)
+        return;
+
+    // positions and quadrics are stored vertex-major, so
+    // scoring an edge over every frame walks memory in order
+    std::vector<glm::dvec3> positions(numVertices * numFrames);
+
+    parallel_for(numVertices, [&](size_t v) {
+        for (size_t f = 0; f < numFrames; f++)
+            positions[v * numFrames + f] = glm::dvec3(mesh.frames[f].vertices[v].position());
+    });
+
+    auto position = [&](size_t f, uint32_t v) -> const glm::dvec3 & { return positions[v * numFrames + f]; };
+
+    // one quadric per vertex per frame, from the planes of its triangles
+    std::vector<Quadric> quadrics(numVertices * numFrames);
+
+    parallel_for(numFrames, [&](size_t f) {
+        for (auto &tri : mesh.triangles)
+        {
+            glm::dvec3 p0 = position(f, tri.vertices[0]);
+            glm::dvec3 n = glm::cross(position(f, tri.vertices[1]) - p0, position(f, tri.vertices[2]) - p0);
+            double area = glm::length(n);
+
+            if (area <= 0)
+                continue;
+
+            n /= area;
+            Quadric plane = Quadric::plane(n, -glm::dot(n, p0), area);
+
+            for (auto &v : tri.vertices)
+                quadrics[v * numFrames + f] += plane;
+        }
+    });
+
+    std::vector<std::vector<uint32_t>> adjacency(numVertices);
+
+    for (uint32_t t = 0; t < mesh.triangles.size(); t++)
+        for (auto &v : mesh.triangles[t].vertices)
+            adjacency[v].push_back(t);
+
+    std::vector<uint8_t> deadTriangles(mesh.triangles.size(), 0), deadVertices(numVertices, 0);
+    std::vector<uint32_t> versions(numVertices, 0);
+
+    auto cost = [&](uint32_t u, uint32_t v) {
+        double error = 0;
+
+        for (size_t f = 0; f < numFrames; f++)
+        {
+            Quadric q = quadrics[u * numFrames + f];
+            q += quadrics[v * numFrames + f];
+            error += q.error(position(f, v));
+        }
+
+        return error;
+    };
+
+    struct Candidate
+    {
+        double   cost;
+        uint32_t u, v;
+        uint32_t uVersion = 0, vVersion = 0;
+
+        bool operator>(const Candidate &other) const { return cost > other.cost; }
+    };
+
+    // score every edge, both ways, up front
+    std::vector<Candidate> candidates;
+    candidates.reserve(mesh.triangles.size() * 6);
+
+    for (auto &tri : mesh.triangles)
+        for (size_t i = 0; i < 3; i++)
+        {
+            candidates.push_back({ 0, tri.vertices[i], tri.vertices[(i + 1) % 3] });
+            candidates.push_back({ 0, tri.vertices[(i + 1) % 3], tri.vertices[i] });
+        }
+
+    std::sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) { return std::tie(a.u, a.v) < std::tie(b.u, b.v); });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](auto &a, auto &b) { return a.u == b.u && a.v == b.v; }), candidates.end());
+
+    parallel_for(candidates.size(), [&](size_t i) {
+        candidates[i].cost = cost(candidates[i].u, candidates[i].v);
+    });
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap(std::greater<Candidate>(), std::move(candidates));
+
+    auto push = [&](uint32_t u, uint32_t v) {
+        heap.push({ cost(u, v), u, v, versions[u], versions[v] });
+    };
+
+    // live triangles around `u` that also use `v`
+    auto shared = [&](uint32_t u, uint32_t v, std::vector<uint32_t> &out) {
+        out.clear();
+
+        for (auto &t : adjacency[u])
+            if (!deadTriangles[t] && std::find(mesh.triangles[t].vertices.begin(), mesh.triangles[t].vertices.end(), v) != mesh.triangles[t].vertices.end())
+                out.push_back(t);
+    };
+
+    auto cornerOf = [&](uint32_t t, uint32_t v) {
+        auto &tri = mesh.triangles[t];
+        return (size_t) (std::find(tri.vertices.begin(), tri.vertices.end(), v) - tri.vertices.begin());
+    };
+
+    std::vector<uint32_t> edgeTris, neighbors, otherNeighbors, scratch;
+
+    auto collectNeighbors = [&](uint32_t u, std::vector<uint32_t> &out) {
+        out.clear();
+
+        for (auto &t : adjacency[u])
+            if (!deadTriangles[t])
+                for (auto &w : mesh.triangles[t].vertices)
+                    if (w != u)
+                        out.push_back(w);
+
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    };
+
+    // u can move onto v without tearing seams, borders or the surface
+    auto canCollapse = [&](uint32_t u, uint32_t v, uint32_t &texcoord) {
+        shared(u, v, edgeTris);
+
+        if (edgeTris.empty())
+            return false;
+
+        // u must use a single texcoord, and v one texcoord along the edge
+        std::optional<uint32_t> uTexcoord;
+
+        for (auto &t : adjacency[u])
+        {
+            if (deadTriangles[t])
+                continue;
+
+            uint32_t tc = mesh.triangles[t].texcoords[cornerOf(t, u)];
+
+            if (uTexcoord && *uTexcoord != tc)
+                return false;
+
+            uTexcoord = tc;
+        }
+
+        texcoord = mesh.triangles[edgeTris[0]].texcoords[cornerOf(edgeTris[0], v)];
+
+        for (auto &t : edgeTris)
+            if (mesh.triangles[t].texcoords[cornerOf(t, v)] != texcoord)
+                return false;
+
+        // u must not be on an open border
+        collectNeighbors(u, neighbors);
+
+        for (auto &w : neighbors)
+        {
+            shared(u, w, scratch);
+
+            if (scratch.size() < 2)
+                return false;
+        }
+
+        // link condition: the only vertices u and v share are
+        // the ones across the triangles that are removed
+        collectNeighbors(v, otherNeighbors);
+        size_t common = 0;
+
+        for (auto &w : neighbors)
+            if (std::binary_search(otherNeighbors.begin(), otherNeighbors.end(), w))
+                common++;
+
+        if (common != edgeTris.size())
+            return false;
+
+        // no triangle that survives may flip, in any frame. a few
+        // small turns can add up to a flip, so each collapse may
+        // only turn a normal so far.
+        constexpr double maxTurnCos = 0.2;
+
+        for (auto &t : adjacency[u])
+        {
+            if (deadTriangles[t] || std::find(edgeTris.begin(), edgeTris.end(), t) != edgeTris.end())
+                continue;
+
+            auto tri = mesh.triangles[t].vertices;
+            size_t c = cornerOf(t, u);
+
+            for (size_t f = 0; f < numFrames; f++)
+            {
+                glm::dvec3 p0 = position(f, tri[0]), p1 = position(f, tri[1]), p2 = position(f, tri[2]);
+                glm::dvec3 before = glm::cross(p1 - p0, p2 - p0);
+                (c == 0 ? p0 : c == 1 ? p1 : p2) = position(f, v);
+                glm::dvec3 after = glm::cross(p1 - p0, p2 - p0);
+
+                if (glm::dot(before, after) <= maxTurnCos * glm::length(before) * glm::length(after))
+                    return false;
+            }
+        }
+
+        return true;
+    };
+
+    while (liveTriangles > targetTriangles && !heap.empty())
+    {
+        Candidate candidate = heap.top();
+        heap.pop();
+
+        uint32_t u = candidate.u, v = candidate.v, texcoord;
+
+        if (deadVertices[u] || deadVertices[v] || versions[u] != candidate.uVersion || versions[v] != candidate.vVersion)
+            continue;
+        else if (!canCollapse(u, v, texcoord))
+            continue;
+
+        for (auto &t : edgeTris)
+        {
+            deadTriangles[t] = 1;
+            liveTriangles--;
+        }
+
+        for (auto &t : adjacency[u])
+        {
+            if (deadTriangles[t])
+                continue;
+
+            size_t c = cornerOf(t, u);
+            mesh.triangles[t].vertices[c] = v;
+            mesh.triangles[t].texcoords[c] = texcoord;
+            adjacency[v].push_back(t);
+        }
+
+        std::erase_if(adjacency[v], [&](uint32_t t) { return deadTriangles[t]; });
+        adjacency[u].clear();
+        deadVertices[u] = 1;
+
+        for (size_t f = 0; f < numFrames; f++)
+            quadrics[v * numFrames + f] += quadrics[u * numFrames + f];
+
+        // only v's quadric changed, so only edges touching v are
+        // stale; the rest of each neighbor's edges stay queued.
+        versions[v]++;
+        collectNeighbors(v, neighbors);
+
+        for (auto &w : neighbors)
+        {
+            push(v, w);
+            push(w, v);
+        }
+    }
+
+    std::vector<ModelTriangle> triangles;
+    triangles.reserve(liveTriangles);
+
+    for (size_t t = 0; t < mesh.triangles.size(); t++)
+        if (!deadTriangles[t])
+            triangles.push_back(mesh.triangles[t]);
+
+    mesh.triangles = std::move(triangles);
+    CompactMesh(mesh);
+}
+
+// furthest distance between the same vertex or tag in frames
+// `a` and `b`, or nothing as soon as it's past `tolerance`
+static std::optional<float> FrameDistance(const std::vector<ModelMesh> &meshes, uint32_t a, uint32_t b, float tolerance)
+{
+    float toleranceSq = tolerance * tolerance, furthest = 0.0f;
+
+    for (auto &mesh : meshes)
+    {
+        auto &va = mesh.frames[a].vertices, &vb = mesh.frames[b].vertices;
+
+        for (size_t v = 0; v < va.size(); v++)
+        {
+            glm::vec3 d = va[v].position() - vb[v].position();
+            furthest = std::max(furthest, glm::dot(d, d));
+
+            if (furthest > toleranceSq)
+                return std::nullopt;
+        }
+    }
+
+    return std::sqrt(furthest);
+}
+
+std::vector<FrameDuplicate> FindDuplicateFrames(const std::vector<ModelMesh> &meshes, float tolerance)
+{
+    size_t numFrames = meshes.empty() ? 0 : meshes[0].frames.size();
+    std::vector<uint64_t> hashes(numFrames);
+
+    parallel_for(numFrames, [&](size_t f) {
+        // FNV-1a over the quantized positions; with no tolerance,
+        // over the exact values (with -0 folded into 0)
+        uint64_t hash = 0xcbf29ce484222325ull;
+
+        for (auto &mesh : meshes)
+            for (auto &v : mesh.frames[f].vertices)
+                for (size_t a = 0; a < 3; a++)
+                {
+                    float p = v.position()[a];
+                    int64_t q;
+
+                    if (tolerance > 0)
+                        q = (int64_t) std::floor(p / tolerance);
+                    else
+                    {
+                        p += 0.0f;
+                        q = std::bit_cast<uint32_t>(p);
+                    }
+
+                    hash = (hash ^ (uint64_t) q) * 0x100000001b3ull;
+                }
+
+        hashes[f] = hash;
+    });
+
+    std::vector<FrameDuplicate> duplicates;
+    std::vector<uint32_t> originals(numFrames);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+
+    for (uint32_t f = 0; f < numFrames; f++)
+    {
+        auto &bucket = buckets[hashes[f]];
+        std::optional<FrameDuplicate> match;
+
+        auto check = [&](uint32_t original) {
+            if (!match)
+                if (auto distance = FrameDistance(meshes, original, f, tolerance))
+                    match = FrameDuplicate { f, original, *distance };
+        };
+
+        for (auto &original : bucket)
+            check(original);
+
+        if (f)
+            check(originals[f - 1]);
+
+        if (match)
+        {
+            originals[f] = match->original;
+            duplicates.push_back(*match);
+        }
+        else
+        {
+            originals[f] = f;
+            bucket.push_back(f);
+        }
+    }
+
+    return duplicates;
+}
+
+std::vector<ModelMesh> ExportMeshes(const ModelData &model, std::vector<uint32_t> &frames)
+{
+    std::vector<ModelMesh> meshes = model.meshes;
+
+    frames.resize(model.frames.size());
+    std::iota(frames.begin(), frames.end(), 0);
+
+    if (settings().removeDuplicateFramesOnExport)
+    {
+        auto duplicates = FindDuplicateFrames(meshes, settings().duplicateFrameTolerance);
+
+        if (!duplicates.empty())
+        {
+            std::vector<uint8_t> dropped(frames.size(), 0);
+
+            for (auto &duplicate : duplicates)
+                dropped[duplicate.frame] = 1;
+
+            std::erase_if(frames, [&](uint32_t f) { return dropped[f]; });
+
+            for (auto &mesh : meshes)
+            {
+                std::vector<MeshFrame> kept;
+                kept.reserve(frames.size());
+
+                for (auto &f : frames)
+                    kept.push_back(std::move(mesh.frames[f]));
+
+                mesh.frames = std::move(kept);
+            }
+
+            logger().AddLog("Export: removed {} duplicate frames.", duplicates.size());
+        }
+    }
+
+    if (settings().compactOnExport)
+    {
+        MeshCompactResult removed;
+
+        for (auto &mesh : meshes)
+            removed += CompactMesh(mesh);
+
+        if (!removed.empty())
+            logger().AddLog("Export: dropped {} unused vertices, {} unused texcoords and {} degenerate triangles.", removed.vertices, removed.texcoords, removed.triangles);
+    }
+
+    if (settings().optimizeOnExport)
+    {
+        size_t triangles = 0, missesBefore = 0, missesAfter = 0;
+
+        for (auto &mesh : meshes)
+        {
+            triangles += mesh.triangles.size();
+            missesBefore += VertexCacheMisses(mesh);
+            OptimizeVertexCache(mesh);
+            missesAfter += VertexCacheMisses(mesh);
+        }
+
+        if (triangles)
+            logger().AddLog("Export: vertex cache ACMR {:.3f} -> {:.3f} ({} triangles).", (float) missesBefore / triangles, (float) missesAfter / triangles, triangles);
+    }
+
+    return meshes;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "ModelData.h"
+
+// operations on mesh data that don't go through the
+// mutator; shared by editing commands and the exporters,
+// which work on copies of the meshes.
+
+// marks an entry that a remap drops
+constexpr uint32_t REMAP_DROPPED = std::numeric_limits<uint32_t>::max();
+
+// rebuild a mesh through remap tables; entry i moves to remap[i]
+// (or is dropped), and the first entry mapped to a slot keeps
+// its data. selection is kept if any merged entry was selected.
+// triangles that lose a vertex, or collapse onto fewer than
+// three, are removed. returns the number of triangles removed.
+size_t RemapMesh(ModelMesh &mesh, const std::vector<uint32_t> &vertexRemap, size_t numVertices,
+                 const std::vector<uint32_t> &texcoordRemap, size_t numTexcoords);
+
+// what CompactMesh removed
+struct MeshCompactResult
+{
+    size_t vertices = 0, texcoords = 0, triangles = 0;
+
+    constexpr bool empty() const { return !vertices && !texcoords && !triangles; }
+
+    MeshCompactResult &operator+=(const MeshCompactResult &other)
+    {
+        vertices += other.vertices;
+        texcoords += other.texcoords;
+        triangles += other.triangles;
+        return *this;
+    }
+};
+
+// drop degenerate triangles (repeated or out of range indices),
+// then vertices and texcoords no triangle uses. tags are kept,
+// since they're never part of a triangle.
+MeshCompactResult CompactMesh(ModelMesh &mesh);
+
+// post-transform cache size assumed by the functions below;
+// small enough to hold on any hardware worth targeting.
+constexpr size_t VERTEX_CACHE_SIZE = 16;
+
+// number of vertex transforms a FIFO cache of `cacheSize` misses
+// drawing the triangles in order; divide by the triangle count
+// for the ACMR (average cache miss ratio).
+size_t VertexCacheMisses(const ModelMesh &mesh, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+// reorder triangles for the post-transform cache (Tipsify), then
+// renumber vertices and texcoords in the order they're first used
+// so fetches walk memory forwards. unused vertices and tags are
+// moved to the end. indices must be in range.
+void OptimizeVertexCache(ModelMesh &mesh, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+// one strip or fan of a mesh, as MD2 glcmds store them
+struct MeshPrimitive
+{
+    bool                                 fan = false;
+    // (vertex, texcoord) of each corner, in draw order
+    std::vector<std::array<uint32_t, 2>> corners;
+};
+
+// cover the mesh's triangles with strips and fans, greedily taking
+// the longest one that starts at each unused triangle. triangles only
+// join across edges whose texcoords match too, since each corner
+// can only carry one.
+std::vector<MeshPrimitive> BuildStripsAndFans(const ModelMesh &mesh);
+
+// replace every frame's vertex normals with the area-weighted
+// average of the triangles around them. with a crease angle (in
+// radians), a vertex only averages triangles within that angle of
+// its largest one, so hard edges stay hard on the dominant side.
+// frames are processed in parallel.
+void RecomputeNormals(ModelMesh &mesh, std::optional<float> creaseAngle = std::nullopt);
+
+// reduce the mesh to about `targetTriangles` by collapsing edges in
+// order of quadric error (Garland & Heckbert), with the error summed
+// over every frame so the result holds up through the animation.
+// vertices on UV seams or open borders are never moved, and collapses
+// that would flip a triangle in any frame are skipped; so the target
+// may not be reached. unused vertices and texcoords are dropped.
+void DecimateMesh(ModelMesh &mesh, size_t targetTriangles);
+
+// a frame that matches an earlier one; `distance` is the furthest
+// any vertex or tag is from where it is in `original`.
+struct FrameDuplicate
+{
+    uint32_t frame, original;
+    float    distance;
+
+    bool exact() const { return distance == 0.0f; }
+};
+
+// find frames whose vertices and tags (in every mesh) are all within
+// `tolerance` of an earlier frame that is itself unique. frames are
+// bucketed by a hash of their positions, quantized to `tolerance`,
+// and also checked against the frame before them; that catches near
+// duplicates split across buckets, which are mostly held poses.
+std::vector<FrameDuplicate> FindDuplicateFrames(const std::vector<ModelMesh> &meshes, float tolerance);
+
+// copies of the model's meshes, ready to be written out by an
+// exporter; compacted, cache-optimized and with duplicate frames
+// removed if the settings are on. `frames` receives the model
+// frame each of the meshes' frames came from.
+std::vector<ModelMesh> ExportMeshes(const ModelData &model, std::vector<uint32_t> &frames);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
 #include <string>
 #include <optional>
@@ -49,6 +51,20 @@ struct ModelFrame
     }
 };
 
+// a rectangular region of a skin, in pixels
+struct SkinRect
+{
+    int32_t x, y, w, h;
+
+    // grow this rect to also cover `other`
+    constexpr SkinRect merged(const SkinRect &other) const
+    {
+        int32_t x0 = std::min(x, other.x), y0 = std::min(y, other.y);
+        int32_t x1 = std::max(x + w, other.x + other.w), y1 = std::max(y + h, other.y + other.h);
+        return { x0, y0, x1 - x0, y1 - y0 };
+    }
+};
+
 // a handle that is meant to be implemented
 // by the renderer to handle maintaining
 // renderer-specific skin stuff
@@ -56,8 +72,14 @@ struct RendererSkinHandle
 {
     virtual ~RendererSkinHandle() { }
 
-    // something has changed in the image, re-upload it
-    virtual void MarkDirty() = 0;
+    // something has changed in the image, re-upload it.
+    // if `rect` is set, only that region is re-uploaded;
+    // multiple calls before an Update accumulate.
+    virtual void MarkDirty(std::optional<SkinRect> rect = std::nullopt) = 0;
+
+    // the palette of an indexed image has changed; this
+    // doesn't require the pixels to be re-uploaded.
+    virtual void MarkPaletteDirty() = 0;
 
     // potentially update texture
     virtual void Update(struct ModelSkin &skin) = 0;
@@ -65,6 +87,10 @@ struct RendererSkinHandle
     // bind
     virtual void Bind() const = 0;
 
+    // changes every time the image contents change; unique
+    // across all handles, so caches can key on it alone.
+    virtual uint64_t GetRevision() const = 0;
+
     // imgui handle
     virtual ImTextureID GetTextureHandle() const = 0;
 
@@ -89,6 +115,70 @@ struct ModelSkin
     {
         return std::tie(name, width, height, image, q1_data);
     }
+
+    // the image was swapped out for another; `before` holds what
+    // it was. if the texture still fits, only the pixels that
+    // differ (and the palette, if that changed) are marked for
+    // upload, otherwise it's rebuilt.
+    void imageReplaced(const ModelSkin &before)
+    {
+        if (!handle)
+            return;
+
+        bool indexed = image.is_indexed_valid();
+
+        if (width != before.width || height != before.height ||
+            image.width != before.image.width || image.height != before.image.height ||
+            image.width != width || image.height != height ||
+            indexed != before.image.is_indexed_valid() ||
+            (!indexed && (!image.is_rgba_valid() || !before.image.is_rgba_valid())))
+        {
+            handle.reset();
+            return;
+        }
+
+        if (indexed && before.image.source.palette != image.source.palette)
+            handle->MarkPaletteDirty();
+
+        if (auto rect = changedRegion(before.image))
+            handle->MarkDirty(rect);
+    }
+
+private:
+    // bounds of the pixels that differ from `other`, which
+    // must be the same size and format as our image
+    std::optional<SkinRect> changedRegion(const Image &other) const
+    {
+        bool indexed = image.is_indexed_valid();
+        size_t texel = indexed ? 1 : 4;
+        const uint8_t *a = indexed ? image.indexed() : image.rgba();
+        const uint8_t *b = indexed ? other.indexed() : other.rgba();
+        int32_t x0 = width, y0 = height, x1 = -1, y1 = -1;
+
+        for (int32_t y = 0; y < height; y++)
+        {
+            size_t row = (size_t) y * width * texel;
+
+            // most rows of a local edit are untouched
+            if (!memcmp(a + row, b + row, width * texel))
+                continue;
+
+            for (int32_t x = 0; x < width; x++)
+                if (memcmp(a + row + x * texel, b + row + x * texel, texel))
+                {
+                    x0 = std::min(x0, x);
+                    x1 = std::max(x1, x);
+                }
+
+            y0 = std::min(y0, y);
+            y1 = y;
+        }
+
+        if (y1 < 0)
+            return std::nullopt;
+
+        return SkinRect { x0, y0, x1 - x0 + 1, y1 - y0 + 1 };
+    }
 };
 
 struct ModelVertex
@@ -142,6 +232,29 @@ struct MeshFrameVertex
             return { glm::mix(a.position, b.position, frac), glm::mix(a.normal, b.normal, frac) };
         }
     }
+
+    // as lerp, but the normal is spherically interpolated,
+    // so it stays unit length and turns at a constant rate.
+    static MeshFrameVertex slerp(const MeshFrameVertex &a, const MeshFrameVertex &b, const float &frac)
+    {
+        if (frac == 0.0f)
+            return a;
+        else if (frac == 1.0f)
+            return b;
+
+        float theta = std::acos(std::clamp(glm::dot(a.normal, b.normal), -1.0f, 1.0f));
+        float s = std::sin(theta);
+        glm::vec3 normal;
+
+        if (theta < 0.001f)
+            normal = glm::normalize(glm::mix(a.normal, b.normal, frac));
+        else if (s < 0.001f)
+            normal = frac < 0.5f ? a.normal : b.normal;
+        else
+            normal = (std::sin((1.0f - frac) * theta) / s) * a.normal + (std::sin(frac * theta) / s) * b.normal;
+
+        return { glm::mix(a.position, b.position, frac), normal };
+    }
 };
 
 #include <glm/gtc/quaternion.hpp>
@@ -245,10 +358,10 @@ struct MeshFrameVertTag
         }
     }
 
-    static MeshFrameVertTag lerp(const MeshFrameVertTag &a, const MeshFrameVertTag &b, const float &frac)
+    static MeshFrameVertTag lerp(const MeshFrameVertTag &a, const MeshFrameVertTag &b, const float &frac, bool slerpNormals = false)
     {
         if (a.is_vertex())
-            return { MeshFrameVertex::lerp(a.vertex(), b.vertex(), frac) };
+            return { slerpNormals ? MeshFrameVertex::slerp(a.vertex(), b.vertex(), frac) : MeshFrameVertex::lerp(a.vertex(), b.vertex(), frac) };
         else
             return { MeshFrameTag::lerp(a.tag(), b.tag(), frac) };
     }
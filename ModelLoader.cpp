@@ -1,4 +1,5 @@
 #include <fstream>
+#include <chrono>
 
 #include <zstd.h>
 
@@ -8,12 +9,21 @@
 #include "UI.h"
 #include "UndoRedo.h"
 #include "Log.h"
+#include "Settings.h"
+#include "MeshTools.h"
+#include "IndexList.h"
 
 constexpr int32_t QIM_MAGIC = 'QMOD';
-constexpr int32_t QIM_VERSION = 1;
+constexpr int32_t QIM_VERSION = 3;
+
+// version 2 changed the index lists in selection/transform undo states
+constexpr int32_t QIM_VERSION_COMPACT_INDICES = 2;
+// version 3 added a table of undo state ids to the undo chunk
+constexpr int32_t QIM_VERSION_UNDO_ID_TABLE = 3;
 
 constexpr int32_t QIM_CHUNK_MODEL = 'MODL';
 constexpr int32_t QIM_CHUNK_UNDO = 'UNDO';
+constexpr int32_t QIM_CHUNK_JOURNAL = 'JRNL';
 
 namespace detail
 {
@@ -52,13 +62,19 @@ struct qim_chunk_t
 #define CHECK_ZSTD(x) x
 #define CHECK(x)
 
-void WriteQIMChunk(std::ostream &s, bool compressed, int32_t chunk_id, std::function<void(std::ostream &)> write_chunk)
+void WriteQIMChunk(std::ostream &s, bool compressed, int32_t chunk_id, std::function<void(std::ostream &)> write_chunk, std::vector<QIMChunkStats> *stats = nullptr)
 {
+	auto start = std::chrono::high_resolution_clock::now();
 	std::streamoff chunk_header_offset = s.tellp();
 	qim_chunk_t chunk { chunk_id, 0, compressed ? QIM_FLAG_COMPRESSED : 0 };
 	s <= chunk;
+	std::streamoff chunk_data_offset = s.tellp();
+	size_t rawSize;
 	if (!compressed)
+	{
 		write_chunk(s);
+		rawSize = (size_t) (s.tellp() - chunk_data_offset);
+	}
 	else
 	{
 		std::stringstream c;
@@ -67,6 +83,7 @@ void WriteQIMChunk(std::ostream &s, bool compressed, int32_t chunk_id, std::func
 		c.seekg(0);
 
 		std::string chunkData = c.str();
+		rawSize = chunkData.size();
 		size_t outBufferSize = ZSTD_CStreamOutSize();
 		auto outBuffer = std::make_unique<uint8_t[]>(outBufferSize);
 		
@@ -89,10 +106,15 @@ void WriteQIMChunk(std::ostream &s, bool compressed, int32_t chunk_id, std::func
 	s.seekp(chunk_header_offset);
 	s <= chunk;
 	s.seekp(p);
+
+	if (stats)
+		stats->push_back({ chunk_id, rawSize, chunk.size, std::chrono::duration<float, std::micro>(std::chrono::high_resolution_clock::now() - start).count() });
 }
 
-static void SaveQIM(const ModelData &model, const std::filesystem::path &file)
+static void SaveQIM(const ModelData &model, const std::filesystem::path &file, std::vector<QIMChunkStats> &stats)
 {
+	stats.clear();
+
 	std::ofstream stream(file, std::ios_base::binary | std::ios_base::out);
 
 	if (!stream.good())
@@ -107,19 +129,53 @@ static void SaveQIM(const ModelData &model, const std::filesystem::path &file)
 
 	WriteQIMChunk(stream, true, QIM_CHUNK_MODEL, [&model](std::ostream &stream) {
 		stream <= model;
-	});
+	}, &stats);
+
+	// with a journal, the history is already on disk; only
+	// where it is and how much of it belongs to this save
+	// is stored in the file.
+	std::optional<size_t> committed;
+	auto journal = std::filesystem::path(file).concat(".journal");
 
-	WriteQIMChunk(stream, true, QIM_CHUNK_UNDO, [](std::ostream &stream) {
-		undo().Write(stream);
-	});
+	if (settings().undoJournal)
+	{
+		if (!undo().Journal() || undo().Journal()->Path() != journal)
+			undo().StartJournal(journal);
+
+		committed = undo().CommitJournal();
+	}
+
+	if (committed)
+	{
+		WriteQIMChunk(stream, false, QIM_CHUNK_JOURNAL, [&journal, &committed](std::ostream &stream) {
+			stream <= journal.filename().string() <= committed.value();
+		}, &stats);
+	}
+	else
+	{
+		WriteQIMChunk(stream, true, QIM_CHUNK_UNDO, [](std::ostream &stream) {
+			undo().Write(stream);
+		}, &stats);
+	}
 }
 
-static void LoadQIMChunk(const qim_chunk_t &chunk_header, ModelData &data, std::istream &stream)
+static void LoadQIMChunk(const qim_chunk_t &chunk_header, ModelData &data, std::istream &stream, const std::filesystem::path &file)
 {
 	if (chunk_header.id == QIM_CHUNK_MODEL)
 		stream >= data;
 	else if (chunk_header.id == QIM_CHUNK_UNDO)
-		undo().Read(stream);
+	{
+		set_legacy_index_lists(stream, qim_version(stream) < QIM_VERSION_COMPACT_INDICES);
+		undo().Read(stream, qim_version(stream) >= QIM_VERSION_UNDO_ID_TABLE);
+	}
+	else if (chunk_header.id == QIM_CHUNK_JOURNAL)
+	{
+		std::string name;
+		size_t committed;
+		stream >= name >= committed;
+
+		undo().OpenJournal(file.parent_path() / name, committed);
+	}
 }
 
 std::unique_ptr<ModelData> LoadQIM(const std::filesystem::path &file)
@@ -156,7 +212,8 @@ std::unique_ptr<ModelData> LoadQIM(const std::filesystem::path &file)
 
 		// unknown chunk
 		if (chunk_header.id != QIM_CHUNK_MODEL && 
-			chunk_header.id != QIM_CHUNK_UNDO)
+			chunk_header.id != QIM_CHUNK_UNDO &&
+			chunk_header.id != QIM_CHUNK_JOURNAL)
 		{
 			stream.seekg(chunk_header.size, std::ios_base::cur);
 			continue;
@@ -164,7 +221,7 @@ std::unique_ptr<ModelData> LoadQIM(const std::filesystem::path &file)
 
 		// valid chunk, decompress if necessary
 		if (!(chunk_header.flags & QIM_FLAG_COMPRESSED))
-			LoadQIMChunk(chunk_header, data, stream);
+			LoadQIMChunk(chunk_header, data, stream, file);
 		else
 		{
 			std::stringstream decompressed;
@@ -193,7 +250,8 @@ std::unique_ptr<ModelData> LoadQIM(const std::filesystem::path &file)
 			ZSTD_freeDCtx(dctx);
 
 			decompressed.seekg(0);
-			LoadQIMChunk(chunk_header, data, decompressed);
+			set_qim_version(decompressed, qim_version(stream));
+			LoadQIMChunk(chunk_header, data, decompressed, file);
 		}
 	}
 
@@ -399,6 +457,10 @@ constexpr uint8_t CompressNormal(const glm::vec3 &v)
 constexpr int32_t MD2_MAGIC = (('2'<<24)+('P'<<16)+('D'<<8)+'I');
 constexpr int32_t MD2_VERSION = 8;
 
+constexpr size_t MD2_MAX_TRIANGLES = 4096;
+constexpr size_t MD2_MAX_VERTS = 2048;
+constexpr size_t MD2_MAX_FRAMES = 512;
+constexpr size_t MD2_MAX_SKINS = 32;
 constexpr size_t MD2_MAX_SKINNAME = 64;
 constexpr size_t MD2_MAX_FRAMENAME = 16;
 
@@ -570,15 +632,21 @@ static std::unique_ptr<ModelData> LoadMD2(const std::filesystem::path &file)
 		stream >= skin_path;
 		skin.name = skin_path.c_str();
 		
-		// try to find the matching image file, convert to rgba
-		if (auto skin_file = images().ResolveSkinFile(model_dir, skin_path.c_str(), { "pcx", "tga", "png" }))
+		// try to find the matching image file; its header is checked
+		// first, so files we can't read are never loaded whole.
+		auto skin_file = images().ResolveSkinFile(model_dir, skin_path.c_str(), { "pcx", "tga", "png" });
+		auto info = skin_file ? images().Info(skin_file.value()) : std::nullopt;
+
+		if (info)
 		{
-			auto image = images().Load(skin_file.value());
+			if (info->width != (uint32_t) header.skinwidth || info->height != (uint32_t) header.skinheight)
+				logger().AddLog("MD2: skin {} is {}x{}; the model expects {}x{}.", skin.name, info->width, info->height, header.skinwidth, header.skinheight);
 
-			if (!image.is_valid())
-				continue;
+			skin.image = images().Load(skin_file.value());
+		}
 
-			skin.image = std::move(image);
+		if (skin.image.is_valid())
+		{
 			skin.width = skin.image.width;
 			skin.height = skin.image.height;
 		}
@@ -998,14 +1066,179 @@ bool ModelLoader::Load(const std::filesystem::path &file)
 	return true;
 }
 
-static void SaveMD2(const ModelData &model, const std::filesystem::path &file) { }
+static void SaveMD2(const ModelData &model, const std::filesystem::path &file)
+{
+	std::vector<uint32_t> frames;
+	auto meshes = ExportMeshes(model, frames);
+
+	// MD2 has a single mesh and no tags; merge everything
+	ModelMesh merged;
+	merged.frames.resize(frames.size());
+
+	for (auto &mesh : meshes)
+	{
+		std::vector<uint32_t> remap(mesh.vertices.size(), REMAP_DROPPED);
+		uint32_t texcoordBase = (uint32_t) merged.texcoords.size();
+
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+		{
+			if (!mesh.frames[0].vertices[i].is_vertex())
+				continue;
+
+			remap[i] = (uint32_t) merged.vertices.size();
+			merged.vertices.push_back(mesh.vertices[i]);
+
+			for (size_t f = 0; f < merged.frames.size(); f++)
+				merged.frames[f].vertices.push_back(mesh.frames[f].vertices[i]);
+		}
+
+		merged.texcoords.insert(merged.texcoords.end(), mesh.texcoords.begin(), mesh.texcoords.end());
+
+		for (auto tri : mesh.triangles)
+		{
+			for (size_t i = 0; i < 3; i++)
+			{
+				tri.vertices[i] = remap[tri.vertices[i]];
+				tri.texcoords[i] += texcoordBase;
+			}
+
+			merged.triangles.push_back(tri);
+		}
+	}
+
+	// the engine's fixed-size arrays; a file past these
+	// would load garbage or crash, so don't write one.
+	auto checkLimit = [](const char *what, size_t count, size_t limit) {
+		if (count <= limit)
+			return true;
+
+		logger().AddLog("MD2: model has {} {}, but the format allows at most {}; the file was not saved.", count, what, limit);
+		return false;
+	};
+
+	// check them all, so every problem is reported at once
+	bool valid = checkLimit("vertices", merged.vertices.size(), MD2_MAX_VERTS);
+	valid = checkLimit("triangles", merged.triangles.size(), MD2_MAX_TRIANGLES) && valid;
+	valid = checkLimit("frames", merged.frames.size(), MD2_MAX_FRAMES) && valid;
+	valid = checkLimit("skins", model.skins.size(), MD2_MAX_SKINS) && valid;
+
+	if (!valid)
+		return;
+
+	// texcoords are stored in pixels of the first skin
+	int32_t skinwidth = model.skins.empty() ? 256 : model.skins[0].width;
+	int32_t skinheight = model.skins.empty() ? 256 : model.skins[0].height;
+
+	std::ofstream stream(file, std::ios_base::binary | std::ios_base::out);
+
+	if (!stream.good())
+		throw std::runtime_error("can't open file for writing");
+
+	stream << endianness<std::endian::little>;
+
+	dmdl_t header {};
+	header.ident = MD2_MAGIC;
+	header.version = MD2_VERSION;
+	header.skinwidth = skinwidth;
+	header.skinheight = skinheight;
+	header.num_skins = (int32_t) model.skins.size();
+	header.num_xyz = (int32_t) merged.vertices.size();
+	header.num_st = (int32_t) merged.texcoords.size();
+	header.num_tris = (int32_t) merged.triangles.size();
+	header.num_frames = (int32_t) merged.frames.size();
+	// frame header + 4 bytes per vertex
+	header.framesize = (int32_t) (sizeof(float) * 6 + MD2_MAX_FRAMENAME + 4 * merged.vertices.size());
+
+	// filled in once we know where everything went
+	std::streamoff header_offset = stream.tellp();
+	stream <= header;
+
+	header.ofs_skins = (int32_t) (stream.tellp() - header_offset);
+
+	for (auto &skin : model.skins)
+	{
+		cstring_t<MD2_MAX_SKINNAME> name {};
+		std::copy_n(skin.name.begin(), std::min(skin.name.size(), MD2_MAX_SKINNAME - 1), name.data.begin());
+		stream <= name;
+	}
+
+	header.ofs_st = (int32_t) (stream.tellp() - header_offset);
+
+	for (auto &st : merged.texcoords)
+		stream <= dstvert_t { (int16_t) std::round(st.pos.x * skinwidth), (int16_t) std::round(st.pos.y * skinheight) };
+
+	header.ofs_tris = (int32_t) (stream.tellp() - header_offset);
+
+	for (auto &tri : merged.triangles)
+	{
+		dtriangle_t t;
+		std::copy(tri.vertices.begin(), tri.vertices.end(), t.index_xyz.begin());
+		std::copy(tri.texcoords.begin(), tri.texcoords.end(), t.index_st.begin());
+		stream <= t;
+	}
+
+	header.ofs_frames = (int32_t) (stream.tellp() - header_offset);
+
+	for (size_t i = 0; i < merged.frames.size(); i++)
+	{
+		auto &meshframe = merged.frames[i];
+		aabb3 bounds = meshframe.bounds();
+
+		daliasframe_t frame_header {};
+		frame_header.scale = (bounds.maxs - bounds.mins) / 255.0f;
+		frame_header.translate = bounds.mins;
+		auto &name = model.frames[frames[i]].name;
+		std::copy_n(name.begin(), std::min(name.size(), MD2_MAX_FRAMENAME - 1), frame_header.name.data.begin());
+		stream <= frame_header;
+
+		for (auto &vert : meshframe.vertices)
+		{
+			dtrivertx_t v;
+
+			for (size_t a = 0; a < 3; a++)
+				v.v[a] = frame_header.scale[a] ? (uint8_t) std::clamp(std::round((vert.vertex().position[a] - frame_header.translate[a]) / frame_header.scale[a]), 0.0f, 255.0f) : 0;
+
+			v.lightnormalindex = CompressNormal(vert.vertex().normal);
+			stream <= v;
+		}
+	}
+
+	// glcmds: a count (negative for fans) then s, t, index for each
+	// corner, for every strip and fan; terminated with a zero.
+	header.ofs_glcmds = (int32_t) (stream.tellp() - header_offset);
+
+	auto primitives = BuildStripsAndFans(merged);
+	size_t corners = 0;
+
+	for (auto &primitive : primitives)
+	{
+		int32_t count = (int32_t) primitive.corners.size();
+		stream <= (primitive.fan ? -count : count);
+
+		for (auto &[vertex, texcoord] : primitive.corners)
+			stream <= merged.texcoords[texcoord].pos.x <= merged.texcoords[texcoord].pos.y <= (int32_t) vertex;
+
+		corners += primitive.corners.size();
+	}
+
+	stream <= (int32_t) 0;
+	header.num_glcmds = (int32_t) (primitives.size() + corners * 3 + 1);
+
+	header.ofs_end = (int32_t) (stream.tellp() - header_offset);
+
+	stream.seekp(header_offset);
+	stream <= header;
+
+	if (!primitives.empty())
+		logger().AddLog("MD2: {} triangles in {} strips/fans, {:.2f} vertices per primitive.", merged.triangles.size(), primitives.size(), (float) corners / primitives.size());
+}
 
-void ModelLoader::Save(const std::filesystem::path &file) const
+void ModelLoader::Save(const std::filesystem::path &file)
 {
 	if (file.extension() == ".md2")
 		SaveMD2(model(), file);
 	else if (file.extension() == ".qim")
-		SaveQIM(model(), file);
+		SaveQIM(model(), file, _lastSaveChunks);
 	else
 		throw std::runtime_error("invalid file type");
 }
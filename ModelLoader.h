@@ -5,17 +5,30 @@
 #include "ModelData.h"
 #include "ModelMutator.h"
 
+// what one chunk of the last saved QIM cost
+struct QIMChunkStats
+{
+	int32_t	id;
+	size_t	rawSize;	// before compression
+	size_t	storedSize;	// on disk
+	float	writeTime;	// microseconds, including compression
+};
+
 class ModelLoader
 {
 public:
 	bool Load(const std::filesystem::path &file);
-	void Save(const std::filesystem::path &file) const;
+	void Save(const std::filesystem::path &file);
 
 	const ModelData &model() const;
 	ModelMutator mutator();
 
+	// chunks written by the last QIM save, in file order
+	const std::vector<QIMChunkStats> &LastSaveChunks() const { return _lastSaveChunks; }
+
 private:
 	std::unique_ptr<ModelData> _model = std::make_unique<ModelData>(ModelData::blankModel());
+	std::vector<QIMChunkStats> _lastSaveChunks;
 };
 
 ModelLoader &model();
\ No newline at end of file
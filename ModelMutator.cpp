@@ -1,8 +1,166 @@
 #include <unordered_set>
+#include <unordered_map>
+#include <limits>
 #include <sul/dynamic_bitset.hpp>
+#include <glm/matrix.hpp>
 #include "UndoRedo.h"
+#include "IndexList.h"
+#include "ModelSnapshot.h"
+#include "Parallel.h"
+#include "MeshTools.h"
 #include "ModelLoader.h"
 #include "UI.h"
+#include "Log.h"
+
+#pragma region(Transactions)
+// tell the renderer its buffers are stale; inside a
+// transaction, this waits until the transaction ends.
+static void MarkBufferDirty()
+{
+    if (auto &transaction = undo().Transaction(); transaction.depth)
+        transaction.dirty = true;
+    else
+        ui().editor3D().renderer().markBufferDirty();
+}
+
+// what a transaction commits as; the states its edits
+// pushed, undone and redone as one, under its own name.
+class UndoRedoStateTransaction : public UndoRedoCombinedState
+{
+public:
+    UndoRedoStateTransaction() = default;
+
+    UndoRedoStateTransaction(std::string name, UndoRedoCombinedState &&states) :
+        UndoRedoCombinedState(std::move(states)),
+        name(std::move(name))
+    {
+        _size += this->name.capacity();
+    }
+
+	const char *Name() const override
+    {
+        return name.c_str();
+    }
+
+	virtual void Read(std::istream &input) override
+    {
+        input >= name;
+        UndoRedoCombinedState::Read(input);
+        _size += name.capacity();
+    }
+
+	virtual void Write(std::ostream &output) const override
+    {
+        output <= name;
+        UndoRedoCombinedState::Write(output);
+    }
+
+	SET_UNDO_REDO_ID(UndoRedoStateTransaction)
+
+private:
+    std::string name;
+};
+
+REGISTER_UNDO_REDO_ID(UndoRedoStateTransaction);
+
+void ModelMutator::beginTransaction()
+{
+    auto &transaction = undo().Transaction();
+
+    if (transaction.depth)
+    {
+        transaction.depth++;
+        return;
+    }
+
+    // anything still waiting to be pushed belongs before us
+    undo().RunDeferred(true);
+    transaction.depth = 1;
+    transaction.states = {};
+    transaction.dirty = transaction.aborted = false;
+}
+
+void ModelMutator::commitTransaction(const char *name)
+{
+    auto &transaction = undo().Transaction();
+
+    if (!transaction.depth)
+        throw std::runtime_error("commitTransaction without beginTransaction");
+    else if (transaction.depth > 1)
+    {
+        transaction.depth--;
+        return;
+    }
+
+    endTransaction(name);
+}
+
+void ModelMutator::rollbackTransaction()
+{
+    auto &transaction = undo().Transaction();
+
+    if (!transaction.depth)
+        throw std::runtime_error("rollbackTransaction without beginTransaction");
+
+    transaction.aborted = true;
+
+    if (transaction.depth > 1)
+    {
+        transaction.depth--;
+        return;
+    }
+
+    endTransaction(nullptr);
+}
+
+ModelTransaction::~ModelTransaction()
+{
+    // throwing here while unwinding would terminate
+    try
+    {
+        if (std::uncaught_exceptions() > _exceptions)
+            _mutator.rollbackTransaction();
+        else
+            _mutator.commitTransaction(_name);
+    }
+    catch (const std::exception &e)
+    {
+        logger().AddLog("Transaction \"{}\" couldn't be ended: {}", _name, e.what());
+    }
+}
+
+bool ModelMutator::inTransaction() const
+{
+    return undo().Transaction().depth != 0;
+}
+
+void ModelMutator::endTransaction(const char *name)
+{
+    auto &transaction = undo().Transaction();
+
+    // a frame change still waiting to be pushed is part of it
+    undo().RunDeferred(true);
+
+    auto states = std::move(transaction.states);
+    transaction.states = {};
+    transaction.depth = 0;
+
+    if (transaction.aborted)
+    {
+        // put back whatever its edits changed
+        if (!states.getStates().empty())
+        {
+            states.Undo(data);
+            transaction.dirty = true;
+        }
+    }
+    else if (!states.getStates().empty())
+        undo().Push(new UndoRedoStateTransaction(name, std::move(states)));
+
+    if (transaction.dirty)
+        MarkBufferDirty();
+}
+#pragma endregion
 
 #pragma region(Frame Operations)
 class UndoRedoStateFrameChanged : public UndoRedoState
@@ -21,14 +179,14 @@ public:
     {
         data->selectedFrame = from;
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
         data->selectedFrame = to;
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -48,6 +206,8 @@ public:
 
     virtual size_t Size() const override { return sizeof(*this); }
 
+    virtual bool Checkpointable() const override { return true; }
+
 	SET_UNDO_REDO_ID(UndoRedoStateFrameChanged)
 
 private:
@@ -67,7 +227,7 @@ void ModelMutator::setSelectedFrame(int32_t frame)
         }
     );
     data->selectedFrame = frame;
-    ui().editor3D().renderer().markBufferDirty();
+    MarkBufferDirty();
 }
 
 class UndoRedoStateFrameNameChanged : public UndoRedoState
@@ -111,6 +271,8 @@ public:
 
     virtual size_t Size() const override { return sizeof(*this) + from.size() + to.size() + 2; }
 
+    virtual bool Checkpointable() const override { return true; }
+
 	SET_UNDO_REDO_ID(UndoRedoStateFrameNameChanged)
 
 private:
@@ -128,6 +290,396 @@ void ModelMutator::setSelectedFrameName(std::string &str)
     data->getSelectedFrame().name = std::move(str);
     undo().Push(state);
 }
+
+// insert `count` frames between each pair of frames in [first, last],
+// blending the pair's vertices and tags. every new frame of every mesh
+// is independent, so they're generated in parallel.
+static void InsertTweenFrames(ModelData &data, int32_t first, int32_t last, int32_t count, bool slerpNormals)
+{
+    const size_t pairs = last - first;
+    const size_t tweens = pairs * count;
+
+    auto frac = [count](size_t t) { return (float) (t % count + 1) / (count + 1); };
+
+    std::vector<std::vector<MeshFrame>> meshTweens(data.meshes.size(), std::vector<MeshFrame>(tweens));
+
+    parallel_for(data.meshes.size() * tweens, [&](size_t i) {
+        size_t m = i / tweens, t = i % tweens;
+        auto &mesh = data.meshes[m];
+        auto &a = mesh.frames[first + t / count].vertices;
+        auto &b = mesh.frames[first + t / count + 1].vertices;
+        auto &out = meshTweens[m][t].vertices;
+
+        out.reserve(a.size());
+
+        for (size_t v = 0; v < a.size(); v++)
+            out.push_back(MeshFrameVertTag::lerp(a[v], b[v], frac(t), slerpNormals));
+    });
+
+    // splice them in after each source frame, back to front
+    // so the earlier insertion points don't move
+    for (size_t p = pairs; p-- > 0; )
+    {
+        size_t at = first + p + 1;
+        const ModelFrame &source = data.frames[first + p];
+        std::vector<ModelFrame> frames;
+
+        for (int32_t n = 0; n < count; n++)
+            frames.push_back({ std::format("{}_{}", source.name, n + 1), source.q1_data });
+
+        data.frames.insert(data.frames.begin() + at, std::make_move_iterator(frames.begin()), std::make_move_iterator(frames.end()));
+
+        for (size_t m = 0; m < data.meshes.size(); m++)
+        {
+            auto begin = meshTweens[m].begin() + p * count;
+            data.meshes[m].frames.insert(data.meshes[m].frames.begin() + at, std::make_move_iterator(begin), std::make_move_iterator(begin + count));
+        }
+    }
+
+    if (data.selectedFrame > first)
+        data.selectedFrame += (std::min(data.selectedFrame, last) - first) * count;
+}
+
+// inverse of InsertTweenFrames
+static void RemoveTweenFrames(ModelData &data, int32_t first, int32_t last, int32_t count)
+{
+    for (int32_t p = last - first; p-- > 0; )
+    {
+        size_t at = first + p * (count + 1) + 1;
+
+        data.frames.erase(data.frames.begin() + at, data.frames.begin() + at + count);
+
+        for (auto &mesh : data.meshes)
+            mesh.frames.erase(mesh.frames.begin() + at, mesh.frames.begin() + at + count);
+    }
+}
+
+// tween frames can be regenerated from the frames around them,
+// so this only needs to remember where they went.
+class UndoRedoStateTweenFramesInserted : public UndoRedoState
+{
+public:
+    UndoRedoStateTweenFramesInserted() = default;
+
+	UndoRedoStateTweenFramesInserted(int32_t first, int32_t last, int32_t count, bool slerpNormals, int32_t selectedFrame) :
+        UndoRedoState(),
+        first(first),
+        last(last),
+        count(count),
+        slerpNormals(slerpNormals),
+        selectedFrame(selectedFrame)
+    {
+    }
+
+	void Undo(ModelData *data) override
+    {
+        RemoveTweenFrames(*data, first, last, count);
+        data->selectedFrame = selectedFrame;
+
+        MarkBufferDirty();
+    }
+
+	void Redo(ModelData *data) override
+    {
+        data->selectedFrame = selectedFrame;
+        InsertTweenFrames(*data, first, last, count, slerpNormals);
+
+        MarkBufferDirty();
+    }
+
+	const char *Name() const override
+    {
+        return "Insert Tween Frames";
+    }
+
+	virtual void Read(std::istream &input) override
+    {
+        input >= first >= last >= count >= slerpNormals >= selectedFrame;
+    }
+
+	virtual void Write(std::ostream &output) const override
+    {
+        output <= first <= last <= count <= slerpNormals <= selectedFrame;
+    }
+
+    virtual size_t Size() const override { return sizeof(*this); }
+
+    virtual bool Checkpointable() const override { return true; }
+
+	SET_UNDO_REDO_ID(UndoRedoStateTweenFramesInserted)
+
+private:
+    int32_t first, last, count;
+    bool slerpNormals;
+    int32_t selectedFrame;
+};
+
+REGISTER_UNDO_REDO_ID(UndoRedoStateTweenFramesInserted);
+
+void ModelMutator::insertTweenFrames(int32_t first, int32_t last, int32_t count, bool slerpNormals)
+{
+    first = std::max(first, 0);
+    last = std::min(last, (int32_t) data->frames.size() - 1);
+
+    if (count <= 0 || last <= first)
+        return;
+
+    auto state = new UndoRedoStateTweenFramesInserted(first, last, count, slerpNormals, data->selectedFrame);
+    InsertTweenFrames(*data, first, last, count, slerpNormals);
+    undo().Push(state);
+
+    MarkBufferDirty();
+
+    logger().AddLog("Inserted {} tween frames.", (last - first) * count);
+}
+
+class UndoRedoStateFramesRemoved : public UndoRedoState
+{
+public:
+    UndoRedoStateFramesRemoved() = default;
+
+    // keeps its own copy of the frames for as long as it lives;
+    // a checkpoint restore can skip its Redo, so it can't rely
+    // on having been the one to take them out of the model.
+    UndoRedoStateFramesRemoved(const ModelData &data, std::vector<uint32_t> indices, int32_t selectedFrame) :
+        UndoRedoState(),
+        indices(std::move(indices)),
+        selectedFrame(selectedFrame)
+    {
+        frames.reserve(this->indices.size());
+        meshFrames.assign(data.meshes.size(), {});
+
+        for (auto &index : this->indices)
+        {
+            frames.push_back(data.frames[index]);
+
+            for (size_t m = 0; m < data.meshes.size(); m++)
+                meshFrames[m].push_back(data.meshes[m].frames[index]);
+        }
+
+        CalculateSize();
+    }
+
+	void Undo(ModelData *data) override
+    {
+        // give the frames back, front to back
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            data->frames.insert(data->frames.begin() + indices[i], frames[i]);
+
+            for (size_t m = 0; m < data->meshes.size(); m++)
+                data->meshes[m].frames.insert(data->meshes[m].frames.begin() + indices[i], meshFrames[m][i]);
+        }
+
+        data->selectedFrame = selectedFrame;
+
+        MarkBufferDirty();
+    }
+
+	void Redo(ModelData *data) override
+    {
+        // remove the frames, back to front
+        for (size_t i = indices.size(); i-- > 0; )
+        {
+            data->frames.erase(data->frames.begin() + indices[i]);
+
+            for (auto &mesh : data->meshes)
+                mesh.frames.erase(mesh.frames.begin() + indices[i]);
+        }
+
+        // stay on the same frame, or the one before it
+        int32_t removedBefore = (int32_t) (std::upper_bound(indices.begin(), indices.end(), (uint32_t) selectedFrame) - indices.begin());
+        data->selectedFrame = std::max(0, selectedFrame - removedBefore);
+
+        MarkBufferDirty();
+    }
+
+	const char *Name() const override
+    {
+        return "Frames Removed";
+    }
+
+	virtual void Read(std::istream &input) override
+    {
+        input >= indices >= selectedFrame >= frames >= meshFrames;
+
+        CalculateSize();
+    }
+
+	virtual void Write(std::ostream &output) const override
+    {
+        output <= indices <= selectedFrame <= frames <= meshFrames;
+    }
+
+    virtual size_t Size() const override { return _size; }
+
+    virtual bool Checkpointable() const override { return true; }
+
+	SET_UNDO_REDO_ID(UndoRedoStateFramesRemoved)
+
+private:
+    void CalculateSize()
+    {
+        _size = sizeof(*this) + vector_element_size(indices) + vector_element_size(frames);
+
+        for (auto &frame : frames)
+            _size += frame.name.size();
+
+        for (auto &mesh : meshFrames)
+            for (auto &frame : mesh)
+                _size += sizeof(frame) + vector_element_size(frame.vertices);
+    }
+
+    std::vector<uint32_t>               indices; // ascending
+    int32_t                             selectedFrame;
+    std::vector<ModelFrame>             frames;
+    std::vector<std::vector<MeshFrame>> meshFrames;
+    size_t                              _size = 0;
+};
+
+REGISTER_UNDO_REDO_ID(UndoRedoStateFramesRemoved);
+
+void ModelMutator::removeDuplicateFrames(float tolerance)
+{
+    auto duplicates = FindDuplicateFrames(data->meshes, tolerance);
+
+    if (duplicates.empty())
+        return;
+
+    std::vector<uint32_t> indices;
+    indices.reserve(duplicates.size());
+
+    for (auto &duplicate : duplicates)
+        indices.push_back(duplicate.frame);
+
+    auto state = new UndoRedoStateFramesRemoved(*data, std::move(indices), data->selectedFrame);
+    state->Redo(data);
+    undo().Push(state);
+
+    logger().AddLog("Removed {} duplicate frames.", duplicates.size());
+}
+#pragma endregion
+
+#pragma region(Snapshots)
+// generic undo state for edits that are easier to describe
+// by their result than by their inputs; stores only the
+// snapshot sections (and, within those, the chunks) that
+// differ between before and after.
+class UndoRedoStateSnapshot : public UndoRedoState
+{
+public:
+    UndoRedoStateSnapshot() = default;
+
+    UndoRedoStateSnapshot(std::string name, ModelSnapshotDiff diff) :
+        UndoRedoState(),
+        name(std::move(name)),
+        diff(std::move(diff))
+    {
+        CalculateSize();
+    }
+
+	void Undo(ModelData *data) override
+    {
+        ModelSnapshot::apply(*data, diff, false);
+        MarkBufferDirty();
+    }
+
+	void Redo(ModelData *data) override
+    {
+        ModelSnapshot::apply(*data, diff, true);
+        MarkBufferDirty();
+    }
+
+	const char *Name() const override
+    {
+        return name.c_str();
+    }
+
+	virtual void Read(std::istream &input) override
+    {
+        size_t count;
+        input >= name >= count;
+
+        diff.clear();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            ModelSnapshotKey key;
+            std::optional<std::string> before, after;
+            input >= key >= before >= after;
+
+            // rebuild the after side against the before side
+            // so the chunks they have in common are shared again.
+            ModelSnapshotSectionPtr b = before ? ModelSnapshotSection::build(*before, nullptr) : nullptr;
+            ModelSnapshotSectionPtr a = after ? ModelSnapshotSection::build(*after, b) : nullptr;
+            diff.emplace(key, std::make_pair(b, a));
+        }
+
+        CalculateSize();
+    }
+
+	virtual void Write(std::ostream &output) const override
+    {
+        output <= name <= diff.size();
+
+        for (auto &[key, sides] : diff)
+        {
+            output <= key;
+            output <= (sides.first ? std::optional(sides.first->bytes()) : std::nullopt);
+            output <= (sides.second ? std::optional(sides.second->bytes()) : std::nullopt);
+        }
+    }
+
+    virtual size_t Size() const override { return _size; }
+
+	SET_UNDO_REDO_ID(UndoRedoStateSnapshot)
+
+private:
+    void CalculateSize()
+    {
+        _size = sizeof(*this) + name.capacity();
+
+        // chunks shared between the two sides only count once
+        std::unordered_set<const void *> seen;
+
+        for (auto &[key, sides] : diff)
+            for (auto &section : { sides.first, sides.second })
+                if (section)
+                    for (auto &chunk : section->chunks)
+                        if (seen.insert(chunk.get()).second)
+                            _size += chunk->capacity();
+    }
+
+    std::string       name;
+    ModelSnapshotDiff diff;
+    size_t            _size = 0;
+};
+
+REGISTER_UNDO_REDO_ID(UndoRedoStateSnapshot);
+
+void ModelMutator::beginSnapshot(uint8_t contents)
+{
+    auto &transaction = undo().Transaction();
+    transaction.snapshot = std::make_unique<ModelSnapshot>(ModelSnapshot::capture(*data, nullptr, contents));
+}
+
+void ModelMutator::pushSnapshot(const char *name)
+{
+    auto &transaction = undo().Transaction();
+
+    if (!transaction.snapshot)
+        throw std::runtime_error("pushSnapshot without beginSnapshot");
+
+    auto before = std::move(transaction.snapshot);
+    auto after = ModelSnapshot::capture(*data, before.get());
+    auto diff = ModelSnapshot::diff(*before, after);
+
+    if (diff.empty())
+        return;
+
+    undo().Push(new UndoRedoStateSnapshot(name, std::move(diff)));
+    MarkBufferDirty();
+}
 #pragma endregion
 
 #pragma region(Skins)
@@ -147,14 +699,14 @@ public:
     {
         data->selectedSkin = from;
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
         data->selectedSkin = to;
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -278,7 +830,7 @@ public:
     {
         data->skins.pop_back();
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
@@ -292,7 +844,7 @@ public:
         skin.height = h;
         skin.image = Image::create_rgba(w, h);
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -354,7 +906,7 @@ public:
 
         data->selectedSkin = index;
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
@@ -377,7 +929,7 @@ public:
 
         CalculateSize();
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -427,6 +979,8 @@ void ModelMutator::deleteSkin()
     undo().Push(state);
 }
 
+// resizes are recorded as snapshots now; this is kept
+// so that histories saved by older versions still load.
 class UndoRedoStateResizeSkin : public UndoRedoState
 {
 public:
@@ -467,7 +1021,7 @@ public:
         // destroy the resized skin; we'll recreate it on undo.
         skin = {};
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
@@ -488,6 +1042,8 @@ public:
             glm::vec2 old_f2i { (float) 1.0f / oldSkin.width, (float) 1.0f / oldSkin.height };
             glm::vec2 new_f2i { (float) 1.0f / width, (float) 1.0f / height };
 
+            uvData.clear();
+
             for (auto &mesh : data->meshes)
                 for (auto &tc : mesh.texcoords)
                 {
@@ -506,7 +1062,7 @@ public:
 
         CalculateSize(data);
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -561,9 +1117,29 @@ void ModelMutator::resizeSkin(int width, int height, bool resizeUVs, bool resize
     if (!model().model().selectedSkin.has_value())
         return;
 
-    auto state = new UndoRedoStateResizeSkin(model().model().selectedSkin.value(), width, height, resizeUVs, resizeImage);
-    state->Redo(model().mutator().data);
-    undo().Push(state);
+    auto &oldSkin = data->skins[model().model().selectedSkin.value()];
+
+    beginSnapshot(ModelSnapshot::Meshes | ModelSnapshot::Skins);
+
+    if (resizeUVs)
+    {
+        glm::vec2 scale { (float) oldSkin.width / width, (float) oldSkin.height / height };
+
+        for (auto &mesh : data->meshes)
+            for (auto &tc : mesh.texcoords)
+                tc.pos *= scale;
+    }
+
+    ModelSkin newSkin;
+    newSkin.name = oldSkin.name;
+    newSkin.width = width;
+    newSkin.height = height;
+    newSkin.q1_data = oldSkin.q1_data;
+    newSkin.image = oldSkin.image.resized(width, height, resizeImage);
+
+    oldSkin = std::move(newSkin);
+
+    pushSnapshot("Skin Resized");
 }
 
 class UndoRedoStateMoveSkin : public UndoRedoState
@@ -583,14 +1159,14 @@ public:
     {
         cut_paste(data->skins.begin() + new_index, data->skins.begin() + new_index + 1, data->skins.begin() + old_index + (!after ? 1 : 0));
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
         cut_paste(data->skins.begin() + old_index, data->skins.begin() + old_index + 1, data->skins.begin() + new_index + (after ? 1 : 0));
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -648,20 +1224,26 @@ public:
     {
         auto &selectedSkin = *data->getSelectedSkin();
         std::swap(selectedSkin, skin);
-        selectedSkin.handle.reset();
+
+        // the texture belongs to the slot
+        std::swap(selectedSkin.handle, skin.handle);
+        selectedSkin.imageReplaced(skin);
         skin.handle.reset();
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
         auto &selectedSkin = *data->getSelectedSkin();
         std::swap(selectedSkin, skin);
-        selectedSkin.handle.reset();
+
+        // the texture belongs to the slot
+        std::swap(selectedSkin.handle, skin.handle);
+        selectedSkin.imageReplaced(skin);
         skin.handle.reset();
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -723,34 +1305,24 @@ public:
 
 	void Undo(ModelData *data) override
     {
-        for (size_t i = 0, tc = 0; i < mesh_vertices.size(); i++)
-        {
-            size_t mesh_id = mesh_vertices[i++];
-            size_t vertex_count = mesh_vertices[i++];
+        size_t tc = 0;
 
-            for (size_t v = 0; v < vertex_count; v++)
-            {
-                ((data->meshes[mesh_id].*TVertsMember)[mesh_vertices[i++]].*TVertMember) = selection_states[tc++];
-            }
-        }
+        mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            ((data->meshes[mesh_id].*TVertsMember)[index].*TVertMember) = selection_states[tc++];
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
-        for (size_t i = 0, tc = 0; i < mesh_vertices.size(); i++)
-        {
-            size_t mesh_id = mesh_vertices[i++];
-            size_t vertex_count = mesh_vertices[i++];
+        size_t tc = 0;
 
-            for (size_t v = 0; v < vertex_count; v++)
-            {
-                ((data->meshes[mesh_id].*TVertsMember)[mesh_vertices[i++]].*TVertMember) = !selection_states[tc++];
-            }
-        }
+        mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            ((data->meshes[mesh_id].*TVertsMember)[index].*TVertMember) = !selection_states[tc++];
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -770,11 +1342,13 @@ public:
     }
 
     virtual size_t Size() const override { return _size; }
+
+    virtual bool Checkpointable() const override { return true; }
     
     virtual const char *Id() const override { return id.value; }
 
 private:
-    std::vector<size_t> mesh_vertices;
+    IndexList mesh_vertices;
     sul::dynamic_bitset<> selection_states;
     size_t _size = 0;
 
@@ -784,7 +1358,7 @@ private:
         selection_states.shrink_to_fit();
 
         _size = sizeof(*this)
-            + vector_element_size(mesh_vertices)
+            + mesh_vertices.memory_size()
             + (selection_states.num_blocks() * (selection_states.bits_per_block / 8));
     }
 
@@ -795,7 +1369,8 @@ private:
     void SelectInternal(ModelMutator &mutator, int32_t mesh,
                         std::function<std::optional<bool>(const TCoordType &, size_t index)> change)
     {
-        std::optional<size_t> first = std::nullopt;
+        static std::vector<size_t> indices;
+        indices.clear();
         auto data = mutator.data;
 
         for (size_t i = 0; i < (data->meshes[mesh].*TVertsMember).size(); i++)
@@ -805,20 +1380,14 @@ private:
 
             if (!new_state.has_value())
                 continue;
-            else if (new_state.value() == (tc.*TVertMember))
-                continue;
-
-            if (!first.has_value())
-            {
-                mesh_vertices.push_back(mesh);
-                mesh_vertices.push_back(0);
-                first = mesh_vertices.size() - 1;
-            }
+            else if (new_state.value() == (tc.*TVertMember))
+                continue;
 
-            mesh_vertices[first.value()]++;
-            mesh_vertices.push_back(i);
+            indices.push_back(i);
             selection_states.push_back((tc.*TVertMember));
         }
+
+        mesh_vertices.add(mesh, indices);
     }
 
     static void SelectAll(ModelMutator &mutator)
@@ -1067,36 +1636,24 @@ public:
 
 	void Undo(ModelData *data) override
     {
-        for (size_t i = 0, tc = 0; i < mesh_triangles.size(); i++)
-        {
-            size_t mesh_id = mesh_triangles[i++];
-            size_t tri_count = mesh_triangles[i++];
+        size_t tc = 0;
 
-            for (size_t t = 0; t < tri_count; t++)
-            {
-                (data->meshes[mesh_id].triangles[mesh_triangles[i++]].*TTriSelectedMember) = selection_states[tc++];
-            }
-        }
+        mesh_triangles.for_each([&](size_t mesh_id, size_t index) {
+            (data->meshes[mesh_id].triangles[index].*TTriSelectedMember) = selection_states[tc++];
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
-        auto mutator = model().mutator();
+        size_t tc = 0;
 
-        for (size_t i = 0, tc = 0; i < mesh_triangles.size(); i++)
-        {
-            size_t mesh_id = mesh_triangles[i++];
-            size_t tri_count = mesh_triangles[i++];
-
-            for (size_t t = 0; t < tri_count; t++)
-            {
-                (data->meshes[mesh_id].triangles[mesh_triangles[i++]].*TTriSelectedMember) = !selection_states[tc++];
-            }
-        }
+        mesh_triangles.for_each([&](size_t mesh_id, size_t index) {
+            (data->meshes[mesh_id].triangles[index].*TTriSelectedMember) = !selection_states[tc++];
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -1116,11 +1673,13 @@ public:
     }
 
     virtual size_t Size() const override { return _size; }
+
+    virtual bool Checkpointable() const override { return true; }
     
     virtual const char *Id() const override { return id.value; }
 
 private:
-    std::vector<size_t> mesh_triangles;
+    IndexList mesh_triangles;
     sul::dynamic_bitset<> selection_states;
     size_t _size = 0;
 
@@ -1130,7 +1689,7 @@ private:
         selection_states.shrink_to_fit();
 
         _size = sizeof(*this)
-            + vector_element_size(mesh_triangles)
+            + mesh_triangles.memory_size()
             + (selection_states.num_blocks() * (selection_states.bits_per_block / 8));
     }
 
@@ -1139,7 +1698,8 @@ private:
     void SelectInternal(ModelMutator &mutator, int32_t mesh,
                         std::function<std::optional<bool>(const ModelTriangle &, size_t index)> change)
     {
-        std::optional<size_t> first = std::nullopt;
+        static std::vector<size_t> indices;
+        indices.clear();
         auto data = mutator.data;
 
         for (size_t i = 0; i < data->meshes[mesh].triangles.size(); i++)
@@ -1152,17 +1712,11 @@ private:
             else if (new_state.value() == tri.*TTriSelectedMember)
                 continue;
 
-            if (!first.has_value())
-            {
-                mesh_triangles.push_back(mesh);
-                mesh_triangles.push_back(0);
-                first = mesh_triangles.size() - 1;
-            }
-
-            mesh_triangles[first.value()]++;
-            mesh_triangles.push_back(i);
+            indices.push_back(i);
             selection_states.push_back(tri.*TTriSelectedMember);
         }
+
+        mesh_triangles.add(mesh, indices);
     }
 
     static void SelectAll(ModelMutator &mutator)
@@ -1542,35 +2096,23 @@ public:
 
 	void Undo(ModelData *data) override
     {
-        for (size_t i = 0, tc = 0; i < mesh_vertices.size(); i++)
-        {
-            size_t mesh_id = mesh_vertices[i++];
-            size_t vertex_count = mesh_vertices[i++];
+        size_t tc = 0;
 
-            for (size_t v = 0; v < vertex_count; v++)
-            {
-                data->meshes[mesh_id].texcoords[mesh_vertices[i++]].pos = uv_positions[tc++];
-            }
-        }
+        mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            data->meshes[mesh_id].texcoords[index].pos = uv_positions[tc++];
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
-        for (size_t i = 0, tc = 0; i < mesh_vertices.size(); i++)
-        {
-            size_t mesh_id = mesh_vertices[i++];
-            size_t vertex_count = mesh_vertices[i++];
-
-            for (size_t v = 0; v < vertex_count; v++)
-            {
-                auto &p = data->meshes[mesh_id].texcoords[mesh_vertices[i++]].pos;
-                p = glm::vec2(matrix * glm::vec4(p, 0.f, 1.f));
-            }
-        }
+        mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            auto &p = data->meshes[mesh_id].texcoords[index].pos;
+            p = glm::vec2(matrix * glm::vec4(p, 0.f, 1.f));
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -1580,7 +2122,19 @@ public:
 
 	virtual void Read(std::istream &input) override
     {
-        input >= matrix >= mesh_vertices >= uv_positions;
+        input >= matrix;
+
+        // old lists were in selection order, not sorted
+        if (legacy_index_lists(input))
+        {
+            std::vector<size_t> order;
+            mesh_vertices.stream_read_legacy(input, &order);
+            input >= uv_positions;
+            IndexList::reorder(uv_positions, order);
+        }
+        else
+            input >= mesh_vertices >= uv_positions;
+
         CalculateSize();
     }
 
@@ -1591,11 +2145,26 @@ public:
 
     virtual size_t Size() const override { return _size; }
 
+    virtual bool Checkpointable() const override { return true; }
+
+    virtual bool Coalesce(const UndoRedoState &next) override
+    {
+        auto other = dynamic_cast<const UndoRedoUVCoordinatesTransformed *>(&next);
+
+        if (!other || other->mesh_vertices != mesh_vertices)
+            return false;
+
+        // the original data is kept; the next
+        // transform just stacks onto ours.
+        matrix = other->matrix * matrix;
+        return true;
+    }
+
 	SET_UNDO_REDO_ID(UndoRedoUVCoordinatesTransformed)
 
 private:
     glm::mat4              matrix;
-    std::vector<size_t>    mesh_vertices;
+    IndexList              mesh_vertices;
     std::vector<glm::vec2> uv_positions;
     size_t                 _size = 0;
 
@@ -1605,7 +2174,7 @@ private:
         uv_positions.shrink_to_fit();
 
         _size = sizeof(*this)
-            + vector_element_size(mesh_vertices)
+            + mesh_vertices.memory_size()
             + vector_element_size(uv_positions);
     }
 
@@ -1636,14 +2205,14 @@ void ModelMutator::applyUVMatrix(const glm::mat4 &matrix, SelectMode mode)
         if (coords.empty())
             continue;
 
-        state->mesh_vertices.push_back(i);
-        state->mesh_vertices.push_back(coords.size());
+        static std::vector<size_t> sorted;
+        sorted.assign(coords.begin(), coords.end());
+        std::sort(sorted.begin(), sorted.end());
 
-        for (auto &v : coords)
-        {
-            state->mesh_vertices.push_back(v);
+        state->mesh_vertices.add(i, sorted);
+
+        for (auto &v : sorted)
             state->uv_positions.push_back(data->meshes[i].texcoords[v].pos);
-        }
     }
 
     if (!state->mesh_vertices.empty())
@@ -1669,35 +2238,25 @@ public:
 
 	void Undo(ModelData *data) override
     {
-        for (size_t i = 0, vt = 0; i < mesh_vertices.size(); i++)
-        {
-            size_t mesh_id = mesh_vertices[i++];
-            size_t vertex_count = mesh_vertices[i++];
+        size_t vt = 0;
 
-            for (size_t v = 0; v < vertex_count; v++)
-                data->meshes[mesh_id].frames[data->selectedFrame].vertices[mesh_vertices[i++]] = vertice_data[vt++];
-        }
+        mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            data->meshes[mesh_id].frames[data->selectedFrame].vertices[index] = vertice_data[vt++];
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	void Redo(ModelData *data) override
     {
         glm::mat3 normal = matrix;
 
-        for (size_t i = 0, tc = 0; i < mesh_vertices.size(); i++)
-        {
-            size_t mesh_id = mesh_vertices[i++];
-            size_t vertex_count = mesh_vertices[i++];
-
-            for (size_t v = 0; v < vertex_count; v++)
-            {
-                auto &p = data->meshes[mesh_id].frames[data->selectedFrame].vertices[mesh_vertices[i++]];
-                p = p.transform(matrix, normal);
-            }
-        }
+        mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            auto &p = data->meshes[mesh_id].frames[data->selectedFrame].vertices[index];
+            p = p.transform(matrix, normal);
+        });
 
-        ui().editor3D().renderer().markBufferDirty();
+        MarkBufferDirty();
     }
 
 	const char *Name() const override
@@ -1707,7 +2266,19 @@ public:
 
 	virtual void Read(std::istream &input) override
     {
-        input >= matrix >= mesh_vertices >= vertice_data;
+        input >= matrix;
+
+        // old lists were in selection order, not sorted
+        if (legacy_index_lists(input))
+        {
+            std::vector<size_t> order;
+            mesh_vertices.stream_read_legacy(input, &order);
+            input >= vertice_data;
+            IndexList::reorder(vertice_data, order);
+        }
+        else
+            input >= mesh_vertices >= vertice_data;
+
         CalculateSize();
     }
 
@@ -1718,11 +2289,26 @@ public:
 
     virtual size_t Size() const override { return _size; }
 
+    virtual bool Checkpointable() const override { return true; }
+
+    virtual bool Coalesce(const UndoRedoState &next) override
+    {
+        auto other = dynamic_cast<const UndoRedo3DCoordinatesTransformed *>(&next);
+
+        if (!other || other->mesh_vertices != mesh_vertices)
+            return false;
+
+        // the original data is kept; the next
+        // transform just stacks onto ours.
+        matrix = other->matrix * matrix;
+        return true;
+    }
+
 	SET_UNDO_REDO_ID(UndoRedo3DCoordinatesTransformed)
 
 private:
     glm::mat4                     matrix;
-    std::vector<size_t>           mesh_vertices;
+    IndexList                     mesh_vertices;
     std::vector<MeshFrameVertTag> vertice_data;
     size_t                        _size = 0;
 
@@ -1732,7 +2318,7 @@ private:
         vertice_data.shrink_to_fit();
 
         _size = sizeof(*this)
-            + vector_element_size(mesh_vertices)
+            + mesh_vertices.memory_size()
             + vector_element_size(vertice_data);
     }
 
@@ -1756,14 +2342,14 @@ void ModelMutator::apply3DMatrix(const glm::mat4 &matrix, SelectMode mode)
         if (coords.empty())
             continue;
 
-        state->mesh_vertices.push_back(i);
-        state->mesh_vertices.push_back(coords.size());
+        static std::vector<size_t> sorted;
+        sorted.assign(coords.begin(), coords.end());
+        std::sort(sorted.begin(), sorted.end());
 
-        for (auto &v : coords)
-        {
-            state->mesh_vertices.push_back(v);
+        state->mesh_vertices.add(i, sorted);
+
+        for (auto &v : sorted)
             state->vertice_data.push_back(data->meshes[i].frames[data->selectedFrame].vertices[v]);
-        }
     }
 
     if (!state->mesh_vertices.empty())
@@ -1773,8 +2359,415 @@ void ModelMutator::apply3DMatrix(const glm::mat4 &matrix, SelectMode mode)
         undo().Push(std::move(state));
     }
 }
+
+// the same transform applied to a range of frames. well-conditioned
+// matrices are undone by applying the inverse, so all that's kept is
+// the matrix and the selection. for anything close to singular, the
+// inverse would lose precision (or not exist), so the selected
+// vertices are copied instead. tags are always copied, as their
+// orientation doesn't survive a round trip through a scaled matrix.
+class UndoRedo3DFramesTransformed : public UndoRedoState
+{
+public:
+    UndoRedo3DFramesTransformed() = default;
+
+	UndoRedo3DFramesTransformed(const glm::mat4 &matrix, int32_t first, int32_t last) :
+        UndoRedoState(),
+        matrix(matrix),
+        first(first),
+        last(last)
+    {
+    }
+
+    // past this, undoing through the inverse drifts visibly
+    static constexpr float MAX_CONDITION = 1e3f;
+
+    // condition number of the linear part, by the Frobenius norm
+    static bool IsWellConditioned(const glm::mat4 &matrix)
+    {
+        glm::mat3 linear(matrix);
+
+        if (glm::abs(glm::determinant(linear)) <= 1e-6f)
+            return false;
+
+        auto norm = [](const glm::mat3 &m) {
+            return std::sqrt(glm::dot(m[0], m[0]) + glm::dot(m[1], m[1]) + glm::dot(m[2], m[2]));
+        };
+
+        return norm(linear) * norm(glm::inverse(linear)) <= MAX_CONDITION;
+    }
+
+	void Undo(ModelData *data) override
+    {
+        size_t vt = 0, tg = 0;
+
+        if (!vertex_data.empty())
+        {
+            for (int32_t f = first; f <= last; f++)
+                mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+                    auto &p = data->meshes[mesh_id].frames[f].vertices[index];
+
+                    if (p.is_tag())
+                        p = { tag_data[tg++] };
+                    else
+                        p = { vertex_data[vt++] };
+                });
+        }
+        else
+        {
+            glm::mat4 inverse = glm::inverse(matrix);
+            glm::mat3 normal = inverse;
+
+            parallel_for(last - first + 1, [&](size_t f) {
+                mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+                    auto &p = data->meshes[mesh_id].frames[first + f].vertices[index];
+
+                    if (p.is_vertex())
+                        p = p.transform(inverse, normal);
+                });
+            });
+
+            for (int32_t f = first; f <= last; f++)
+                mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+                    auto &p = data->meshes[mesh_id].frames[f].vertices[index];
+
+                    if (p.is_tag())
+                        p = { tag_data[tg++] };
+                });
+        }
+
+        MarkBufferDirty();
+    }
+
+	void Redo(ModelData *data) override
+    {
+        glm::mat3 normal = matrix;
+
+        parallel_for(last - first + 1, [&](size_t f) {
+            mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+                auto &p = data->meshes[mesh_id].frames[first + f].vertices[index];
+                p = p.transform(matrix, normal);
+            });
+        });
+
+        MarkBufferDirty();
+    }
+
+	const char *Name() const override
+    {
+        return "3D Frames Transformed";
+    }
+
+	virtual void Read(std::istream &input) override
+    {
+        input >= matrix >= first >= last >= mesh_vertices >= tag_data >= vertex_data;
+        CalculateSize();
+    }
+
+	virtual void Write(std::ostream &output) const override
+    {
+        output <= matrix <= first <= last <= mesh_vertices <= tag_data <= vertex_data;
+    }
+
+    virtual size_t Size() const override { return _size; }
+
+    virtual bool Checkpointable() const override { return true; }
+
+    virtual bool Coalesce(const UndoRedoState &next) override
+    {
+        auto other = dynamic_cast<const UndoRedo3DFramesTransformed *>(&next);
+
+        if (!other || other->first != first || other->last != last || other->mesh_vertices != mesh_vertices)
+            return false;
+
+        // our copies (if any) are of the original data, so the
+        // combined matrix only matters if we undo through its inverse.
+        glm::mat4 combined = other->matrix * matrix;
+
+        if (vertex_data.empty() && (!other->vertex_data.empty() || !IsWellConditioned(combined)))
+            return false;
+
+        matrix = combined;
+        return true;
+    }
+
+	SET_UNDO_REDO_ID(UndoRedo3DFramesTransformed)
+
+private:
+    glm::mat4                     matrix;
+    int32_t                       first, last;
+    IndexList                     mesh_vertices;
+    // tags in the selection, frame by frame
+    std::vector<MeshFrameTag>     tag_data;
+    // vertices in the selection, frame by frame; only
+    // kept if the matrix is too close to singular.
+    std::vector<MeshFrameVertex>  vertex_data;
+    size_t                        _size = 0;
+
+    void CalculateSize()
+    {
+        mesh_vertices.shrink_to_fit();
+        tag_data.shrink_to_fit();
+        vertex_data.shrink_to_fit();
+
+        _size = sizeof(*this)
+            + mesh_vertices.memory_size()
+            + vector_element_size(tag_data)
+            + vector_element_size(vertex_data);
+    }
+
+    friend class ModelMutator;
+};
+
+REGISTER_UNDO_REDO_ID(UndoRedo3DFramesTransformed);
+
+// apply matrix to selected vertices in every frame from `first` to `last`
+void ModelMutator::apply3DMatrix(const glm::mat4 &matrix, SelectMode mode, int32_t first, int32_t last)
+{
+    if (data->frames.empty())
+        return;
+
+    first = std::clamp(first, 0, (int32_t) data->frames.size() - 1);
+    last = std::clamp(last, first, (int32_t) data->frames.size() - 1);
+
+    auto state = std::make_unique<UndoRedo3DFramesTransformed>(matrix, first, last);
+
+    for (size_t i = 0; i < data->meshes.size(); i++)
+    {
+        if (data->selectedMesh.has_value() && data->selectedMesh != i)
+            continue;
+
+        const auto &coords = getSelectedVertices(data->meshes[i], mode);
+
+        if (coords.empty())
+            continue;
+
+        static std::vector<size_t> sorted;
+        sorted.assign(coords.begin(), coords.end());
+        std::sort(sorted.begin(), sorted.end());
+
+        state->mesh_vertices.add(i, sorted);
+    }
+
+    if (state->mesh_vertices.empty())
+        return;
+
+    bool invertible = UndoRedo3DFramesTransformed::IsWellConditioned(matrix);
+
+    for (int32_t f = first; f <= last; f++)
+        state->mesh_vertices.for_each([&](size_t mesh_id, size_t index) {
+            auto &p = data->meshes[mesh_id].frames[f].vertices[index];
+
+            if (p.is_tag())
+                state->tag_data.push_back(p.tag());
+            else if (!invertible)
+                state->vertex_data.push_back(p.vertex());
+        });
+
+    state->Redo(data);
+    state->CalculateSize();
+    undo().Push(std::move(state));
+}
 #pragma endregion
 
+#pragma region(Mesh Cleanup)
+// bucket of a point in a uniform grid, packed into
+// one key; neighboring cells are found by offsetting.
+template<size_t N>
+static uint64_t SpatialHashKey(const glm::vec<N, int32_t> &cell)
+{
+    uint64_t key = 0;
+
+    for (size_t i = 0; i < N; i++)
+        key = (key << 21) | ((uint64_t) cell[i] & 0x1FFFFF);
+
+    return key;
+}
+
+// merge entries whose positions (as given by `positions(i, layer)`,
+// for every layer) are all within `tolerance` of each other. a
+// spatial hash on layer 0 keeps this close to linear; `mergeable`
+// can exclude entries. returns the remap table and new count.
+template<size_t N, typename TPositions, typename TMergeable>
+static std::pair<std::vector<uint32_t>, size_t> WeldPoints(size_t count, size_t layers, float tolerance, TPositions positions, TMergeable mergeable)
+{
+    using vec = glm::vec<N, float>;
+    using ivec = glm::vec<N, int32_t>;
+    constexpr size_t NEIGHBORS = N == 2 ? 9 : 27;
+
+    std::vector<uint32_t> remap(count);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    float cellSize = std::max(tolerance, 1.0f / 1024);
+    float toleranceSq = tolerance * tolerance;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        std::optional<uint32_t> match;
+
+        if (mergeable(i))
+        {
+            vec p = positions(i, 0);
+            ivec cell = ivec(glm::floor(p / cellSize));
+
+            // the 3^N cells around this one cover every point
+            // within tolerance, since tolerance <= cell size
+            for (size_t n = 0; n < NEIGHBORS && !match; n++)
+            {
+                ivec offset;
+
+                for (size_t a = 0, d = n; a < N; a++, d /= 3)
+                    offset[a] = (int32_t) (d % 3) - 1;
+
+                auto it = cells.find(SpatialHashKey<N>(cell + offset));
+
+                if (it == cells.end())
+                    continue;
+
+                for (uint32_t other : it->second)
+                {
+                    bool close = true;
+
+                    for (size_t layer = 0; layer < layers && close; layer++)
+                    {
+                        vec d = positions(i, layer) - positions(other, layer);
+                        close = glm::dot(d, d) <= toleranceSq;
+                    }
+
+                    if (close)
+                    {
+                        match = remap[other];
+                        break;
+                    }
+                }
+            }
+
+            if (!match)
+                cells[SpatialHashKey<N>(cell)].push_back((uint32_t) i);
+        }
+
+        remap[i] = match ? *match : (uint32_t) kept++;
+    }
+
+    return { std::move(remap), kept };
+}
+
+void ModelMutator::weldVertices(float tolerance)
+{
+    // texcoords are normalized; merge within half a texel
+    float uvTolerance = 0.0f;
+
+    if (auto skin = data->getSelectedSkin())
+        uvTolerance = 0.5f / std::max(skin->width, skin->height);
+
+    size_t weldedVertices = 0, weldedTexcoords = 0, removedTriangles = 0;
+
+    beginSnapshot(ModelSnapshot::Meshes | ModelSnapshot::MeshFrames);
+
+    for (size_t m = 0; m < data->meshes.size(); m++)
+    {
+        if (data->selectedMesh.has_value() && data->selectedMesh != m)
+            continue;
+
+        auto &mesh = data->meshes[m];
+
+        // vertices only weld if they coincide in every frame; tags never do
+        auto [vertexRemap, numVertices] = WeldPoints<3>(mesh.vertices.size(), mesh.frames.size(), tolerance,
+            [&](size_t i, size_t f) { return mesh.frames[f].vertices[i].position(); },
+            [&](size_t i) { return mesh.frames[0].vertices[i].is_vertex(); });
+
+        auto [texcoordRemap, numTexcoords] = WeldPoints<2>(mesh.texcoords.size(), 1, uvTolerance,
+            [&](size_t i, size_t) { return mesh.texcoords[i].pos; },
+            [&](size_t) { return true; });
+
+        if (numVertices == mesh.vertices.size() && numTexcoords == mesh.texcoords.size())
+            continue;
+
+        weldedVertices += mesh.vertices.size() - numVertices;
+        weldedTexcoords += mesh.texcoords.size() - numTexcoords;
+        removedTriangles += RemapMesh(mesh, vertexRemap, numVertices, texcoordRemap, numTexcoords);
+    }
+
+    pushSnapshot("Weld Vertices");
+
+    logger().AddLog("Welded {} vertices and {} texcoords; {} degenerate triangles removed.", weldedVertices, weldedTexcoords, removedTriangles);
+}
+
+void ModelMutator::compactMeshes()
+{
+    MeshCompactResult removed;
+
+    beginSnapshot(ModelSnapshot::Meshes | ModelSnapshot::MeshFrames);
+
+    for (size_t m = 0; m < data->meshes.size(); m++)
+    {
+        if (data->selectedMesh.has_value() && data->selectedMesh != m)
+            continue;
+
+        removed += CompactMesh(data->meshes[m]);
+    }
+
+    pushSnapshot("Compact Mesh");
+
+    logger().AddLog("Removed {} unused vertices, {} unused texcoords and {} degenerate triangles.", removed.vertices, removed.texcoords, removed.triangles);
+}
+
+void ModelMutator::recomputeNormals(std::optional<float> creaseAngle)
+{
+    beginSnapshot(ModelSnapshot::MeshFrames);
+
+    for (size_t m = 0; m < data->meshes.size(); m++)
+    {
+        if (data->selectedMesh.has_value() && data->selectedMesh != m)
+            continue;
+
+        RecomputeNormals(data->meshes[m], creaseAngle);
+    }
+
+    pushSnapshot("Recompute Normals");
+}
+
+void ModelMutator::generateLOD(size_t targetTriangles)
+{
+    std::vector<size_t> sources;
+    size_t totalTriangles = 0;
+
+    for (size_t m = 0; m < data->meshes.size(); m++)
+    {
+        if (data->selectedMesh.has_value() && data->selectedMesh != m)
+            continue;
+        else if (data->meshes[m].triangles.empty())
+            continue;
+
+        sources.push_back(m);
+        totalTriangles += data->meshes[m].triangles.size();
+    }
+
+    if (!totalTriangles)
+        return;
+
+    beginSnapshot(ModelSnapshot::Meshes | ModelSnapshot::MeshFrames);
+
+    size_t resultTriangles = 0;
+
+    for (auto &m : sources)
+    {
+        // meshes share the budget by how many triangles they have
+        ModelMesh lod = data->meshes[m];
+        size_t target = std::max<size_t>(1, targetTriangles * lod.triangles.size() / totalTriangles);
+
+        DecimateMesh(lod, target);
+        lod.name += "_lod";
+        resultTriangles += lod.triangles.size();
+
+        data->meshes.push_back(std::move(lod));
+    }
+
+    pushSnapshot("Generate LOD");
+
+    logger().AddLog("Generated {} LOD mesh(es); {} triangles down to {}.", sources.size(), totalTriangles, resultTriangles);
+}
+
 const std::unordered_set<size_t> &ModelMutator::getSelectedTextureCoordinates(const ModelMesh &mesh, SelectMode mode)
 {
     static std::unordered_set<size_t> verticesSelected;
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <functional>
+#include <exception>
 
 #include "Types.h"
 #include "ModelData.h"
+#include "ModelSnapshot.h"
 #include "Editor3D.h"
 
 class ModelMutator
@@ -20,10 +22,42 @@ public:
 
     constexpr explicit operator bool() const { return isValid(); }
 
+#pragma region(Transactions)
+    // batch every edit until the matching commitTransaction into
+    // one undo state named `name`. the states the edits push in
+    // between are gathered into it, and the renderer is only told
+    // about them once, on commit. transactions nest; only the
+    // outermost commit records anything. rollbackTransaction ends one by
+    // undoing its edits instead; if it's nested, the outermost
+    // transaction rolls back as well. prefer ModelTransaction.
+    void beginTransaction();
+    void commitTransaction(const char *name);
+    void rollbackTransaction();
+    bool inTransaction() const;
+#pragma endregion
+
 #pragma region(Frame Operations)
     void setSelectedFrame(int32_t frame);
 
     void setSelectedFrameName(std::string &str);
+
+    // insert `count` interpolated frames between each pair of
+    // frames in [first, last], as one undo state. with
+    // `slerpNormals` normals are slerped rather than lerped.
+    void insertTweenFrames(int32_t first, int32_t last, int32_t count, bool slerpNormals);
+
+    // remove every frame FindDuplicateFrames reports at `tolerance`.
+    void removeDuplicateFrames(float tolerance);
+#pragma endregion
+
+#pragma region(Snapshots)
+    // capture the model before an edit; pushSnapshot then records
+    // whatever changed since as a single undo state. use for edits
+    // that touch a lot of the model in ways that are awkward to
+    // invert (resizing skins, deleting meshes, whole-frame edits).
+    // `contents` is what the edit can change; see ModelSnapshot.
+    void beginSnapshot(uint8_t contents = ModelSnapshot::Everything);
+    void pushSnapshot(const char *name);
 #pragma endregion
 
 #pragma region(Skins)
@@ -88,6 +122,27 @@ public:
     
 #pragma region(3D Matrix Apply)
     void apply3DMatrix(const glm::mat4 &matrix, SelectMode mode);
+    // as above, but for every frame in [first, last] at once
+    void apply3DMatrix(const glm::mat4 &matrix, SelectMode mode, int32_t first, int32_t last);
+#pragma endregion
+
+#pragma region(Mesh Cleanup)
+    // merge vertices that are within `tolerance` of each other in
+    // every frame, and texcoords within half a texel, in the
+    // selected mesh (or all meshes).
+    void weldVertices(float tolerance);
+
+    // drop degenerate triangles, and vertices and texcoords that
+    // no triangle uses, from the selected mesh (or all meshes).
+    void compactMeshes();
+
+    // smooth, area-weighted normals for every frame of the selected
+    // mesh (or all meshes); see RecomputeNormals for `creaseAngle`.
+    void recomputeNormals(std::optional<float> creaseAngle);
+
+    // add a copy of the selected mesh (or of every mesh, splitting
+    // the budget) decimated to about `targetTriangles`.
+    void generateLOD(size_t targetTriangles);
 #pragma endregion
 
     // return a fixed set of texture coordinate indices that are
@@ -96,4 +151,34 @@ public:
     // FIXME in the future this should be cached state
     const std::unordered_set<size_t> &getSelectedTextureCoordinates(const ModelMesh &mesh, SelectMode mode);
     const std::unordered_set<size_t> &getSelectedVertices(const ModelMesh &mesh, SelectMode mode);
+
+private:
+    // close the outermost transaction
+    void endTransaction(const char *name);
+};
+
+// a transaction for the lifetime of the object; commits as `name`
+// when it goes out of scope, or rolls back if that's because of
+// an exception. never throws from its destructor; a failure to
+// end the transaction is logged instead.
+class ModelTransaction
+{
+public:
+    ModelTransaction(ModelMutator mutator, const char *name) :
+        _mutator(mutator),
+        _name(name),
+        _exceptions(std::uncaught_exceptions())
+    {
+        _mutator.beginTransaction();
+    }
+
+    ~ModelTransaction();
+
+    ModelTransaction(const ModelTransaction &) = delete;
+    ModelTransaction &operator=(const ModelTransaction &) = delete;
+
+private:
+    ModelMutator _mutator;
+    const char   *_name;
+    int          _exceptions;
 };
\ No newline at end of file
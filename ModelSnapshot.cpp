@@ -0,0 +1,193 @@
+#include <sstream>
+#include <cstring>
+
+#include "ModelSnapshot.h"
+
+/*static*/ ModelSnapshotSectionPtr ModelSnapshotSection::build(const std::string &bytes, const ModelSnapshotSectionPtr &previous)
+{
+    auto section = std::make_shared<ModelSnapshotSection>();
+    section->size = bytes.size();
+    section->chunks.reserve((bytes.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    bool changed = !previous || previous->size != bytes.size();
+
+    for (size_t offset = 0, i = 0; offset < bytes.size(); offset += CHUNK_SIZE, i++)
+    {
+        size_t length = std::min(CHUNK_SIZE, bytes.size() - offset);
+
+        if (previous && i < previous->chunks.size())
+        {
+            auto &shared = previous->chunks[i];
+
+            if (shared->size() == length && !memcmp(shared->data(), bytes.data() + offset, length))
+            {
+                section->chunks.push_back(shared);
+                continue;
+            }
+        }
+
+        section->chunks.push_back(std::make_shared<const std::vector<uint8_t>>(bytes.begin() + offset, bytes.begin() + offset + length));
+        changed = true;
+    }
+
+    // nothing changed; share the whole section, so
+    // diffing snapshots is just a pointer compare.
+    if (!changed)
+        return previous;
+
+    return section;
+}
+
+std::string ModelSnapshotSection::bytes() const
+{
+    std::string bytes;
+    bytes.reserve(size);
+
+    for (auto &chunk : chunks)
+        bytes.append((const char *) chunk->data(), chunk->size());
+
+    return bytes;
+}
+
+// header section; everything that decides how many
+// of the other sections there are.
+static void WriteHeader(std::ostream &s, const ModelData &data)
+{
+    s <= data.frames <= data.selectedFrame <= data.selectedSkin <= data.skinPerObject <= data.selectedMesh;
+
+    s <= (uint32_t) data.meshes.size();
+
+    for (auto &mesh : data.meshes)
+        s <= (uint32_t) mesh.frames.size();
+
+    s <= (uint32_t) data.skins.size();
+}
+
+static void ReadHeader(std::istream &s, ModelData &data)
+{
+    s >= data.frames >= data.selectedFrame >= data.selectedSkin >= data.skinPerObject >= data.selectedMesh;
+
+    uint32_t count;
+    s >= count;
+    data.meshes.resize(count);
+
+    for (auto &mesh : data.meshes)
+    {
+        s >= count;
+        mesh.frames.resize(count);
+    }
+
+    s >= count;
+    data.skins.resize(count);
+}
+
+// mesh section; frames are stored separately, so
+// moving vertices doesn't touch topology and vice versa.
+static void WriteMesh(std::ostream &s, const ModelMesh &mesh)
+{
+    s <= mesh.texcoords <= mesh.triangles <= mesh.vertices <= mesh.assigned_skin <= mesh.name;
+}
+
+static void ReadMesh(std::istream &s, ModelMesh &mesh)
+{
+    s >= mesh.texcoords >= mesh.triangles >= mesh.vertices >= mesh.assigned_skin >= mesh.name;
+}
+
+/*static*/ ModelSnapshot ModelSnapshot::capture(const ModelData &data, const ModelSnapshot *previous, uint8_t contents)
+{
+    ModelSnapshot snapshot;
+    snapshot._contents = previous ? previous->_contents : contents;
+    std::ostringstream s(std::ios_base::binary);
+
+    auto add = [&](ModelSnapshotKey key, auto &&writer) {
+        s.str({});
+        writer();
+
+        ModelSnapshotSectionPtr prev;
+
+        if (previous)
+            if (auto it = previous->_sections.find(key); it != previous->_sections.end())
+                prev = it->second;
+
+        snapshot._sections.emplace(key, ModelSnapshotSection::build(s.str(), prev));
+    };
+
+    add({ ModelSnapshotSectionKind::Header }, [&] { WriteHeader(s, data); });
+
+    for (uint32_t m = 0; m < data.meshes.size(); m++)
+    {
+        auto &mesh = data.meshes[m];
+
+        if (snapshot._contents & Meshes)
+            add({ ModelSnapshotSectionKind::Mesh, m }, [&] { WriteMesh(s, mesh); });
+
+        if (snapshot._contents & MeshFrames)
+            for (uint32_t f = 0; f < mesh.frames.size(); f++)
+                add({ ModelSnapshotSectionKind::MeshFrame, m, f }, [&] { s <= mesh.frames[f]; });
+    }
+
+    if (snapshot._contents & Skins)
+        for (uint32_t i = 0; i < data.skins.size(); i++)
+            add({ ModelSnapshotSectionKind::Skin, i }, [&] { s <= data.skins[i]; });
+
+    return snapshot;
+}
+
+/*static*/ ModelSnapshotDiff ModelSnapshot::diff(const ModelSnapshot &before, const ModelSnapshot &after)
+{
+    ModelSnapshotDiff diff;
+
+    for (auto &[key, section] : before._sections)
+    {
+        auto it = after._sections.find(key);
+        auto other = it == after._sections.end() ? nullptr : it->second;
+
+        if (section != other)
+            diff.emplace(key, std::make_pair(section, other));
+    }
+
+    for (auto &[key, section] : after._sections)
+        if (!before._sections.contains(key))
+            diff.emplace(key, std::make_pair(nullptr, section));
+
+    return diff;
+}
+
+/*static*/ void ModelSnapshot::apply(ModelData &data, const ModelSnapshotDiff &diff, bool after)
+{
+    // the header goes first (it's also first in key order),
+    // so every section below has somewhere to go.
+    for (auto &[key, sides] : diff)
+    {
+        auto &section = after ? sides.second : sides.first;
+
+        if (!section)
+            continue;
+
+        std::string bytes = section->bytes();
+        memory_streambuf buf({ (const uint8_t *) bytes.data(), bytes.size() });
+        std::istream s(&buf);
+
+        switch (key.kind)
+        {
+        case ModelSnapshotSectionKind::Header:
+            ReadHeader(s, data);
+            break;
+        case ModelSnapshotSectionKind::Mesh:
+            ReadMesh(s, data.meshes[key.a]);
+            break;
+        case ModelSnapshotSectionKind::MeshFrame:
+            s >= data.meshes[key.a].frames[key.b];
+            break;
+        case ModelSnapshotSectionKind::Skin:
+        {
+            // keep the texture; only what differs is re-uploaded
+            ModelSkin before = std::move(data.skins[key.a]);
+            s >= data.skins[key.a];
+            data.skins[key.a].handle = std::move(before.handle);
+            data.skins[key.a].imageReplaced(before);
+            break;
+        }
+        }
+    }
+}
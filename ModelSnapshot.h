@@ -0,0 +1,94 @@
+#pragma once
+
+#include <compare>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ModelData.h"
+
+// immutable run of serialized model data; shared between
+// snapshots for as long as its contents don't change.
+using ModelSnapshotChunk = std::shared_ptr<const std::vector<uint8_t>>;
+
+// one serialized piece of the model (the header, a mesh,
+// one frame of a mesh, a skin) split into fixed-size chunks.
+// it's a persistent vector of bytes: changing a vertex only
+// costs the chunk it lives in.
+struct ModelSnapshotSection
+{
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+    std::vector<ModelSnapshotChunk> chunks;
+    size_t                          size = 0;
+
+    // split `bytes` into chunks, sharing any that are
+    // identical to the chunk at the same spot in `previous`.
+    // returns `previous` itself if nothing changed.
+    static std::shared_ptr<const ModelSnapshotSection> build(const std::string &bytes, const std::shared_ptr<const ModelSnapshotSection> &previous);
+
+    std::string bytes() const;
+};
+
+using ModelSnapshotSectionPtr = std::shared_ptr<const ModelSnapshotSection>;
+
+enum class ModelSnapshotSectionKind : uint8_t
+{
+    Header,     // frame list, selection, and the size of everything
+    Mesh,       // a = mesh; topology, texcoords and selection
+    MeshFrame,  // a = mesh, b = frame; vertex positions
+    Skin        // a = skin
+};
+
+struct ModelSnapshotKey
+{
+    ModelSnapshotSectionKind kind;
+    uint32_t                 a = 0, b = 0;
+
+    auto operator<=>(const ModelSnapshotKey &) const = default;
+
+    auto stream_data()
+    {
+        return std::tie(kind, a, b);
+    }
+};
+
+// the sections that differ between two snapshots, with
+// the contents of each side; a null side means the section
+// doesn't exist there (a mesh was added or removed).
+using ModelSnapshotDiff = std::map<ModelSnapshotKey, std::pair<ModelSnapshotSectionPtr, ModelSnapshotSectionPtr>>;
+
+// the model as a map of sections. capturing shares every
+// section and chunk that matches `previous`, so a snapshot
+// only costs what changed since then.
+class ModelSnapshot
+{
+public:
+    // what a snapshot covers besides the header; edits leave
+    // out what they can't change, so it's never serialized.
+    enum Contents : uint8_t
+    {
+        Meshes      = 1 << 0,
+        MeshFrames  = 1 << 1,
+        Skins       = 1 << 2,
+
+        Everything  = Meshes | MeshFrames | Skins
+    };
+
+    // with `previous`, its contents are captured instead.
+    static ModelSnapshot capture(const ModelData &data, const ModelSnapshot *previous = nullptr, uint8_t contents = Everything);
+
+    const auto &sections() const { return _sections; }
+
+    // sections that differ from `before` to `after`
+    static ModelSnapshotDiff diff(const ModelSnapshot &before, const ModelSnapshot &after);
+
+    // write one side of a diff back into `data`, which
+    // must currently match the other side.
+    static void apply(ModelData &data, const ModelSnapshotDiff &diff, bool after);
+
+private:
+    std::map<ModelSnapshotKey, ModelSnapshotSectionPtr> _sections;
+    uint8_t                                             _contents = Everything;
+};
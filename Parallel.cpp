@@ -0,0 +1,92 @@
+#include <algorithm>
+
+#include "Parallel.h"
+
+/*static*/ ParallelPool &ParallelPool::get()
+{
+    static ParallelPool pool;
+    return pool;
+}
+
+ParallelPool::ParallelPool()
+{
+    // this thread is a worker too
+    size_t numWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    for (size_t i = 0; i < numWorkers; i++)
+        _threads.emplace_back(&ParallelPool::worker, this);
+}
+
+ParallelPool::~ParallelPool()
+{
+    {
+        std::scoped_lock lock(_lock);
+        _stop = true;
+    }
+
+    _wake.notify_all();
+
+    for (auto &thread : _threads)
+        thread.join();
+}
+
+void ParallelPool::run(size_t count, const std::function<void(size_t)> &func)
+{
+    std::unique_lock busy(_busy, std::try_to_lock);
+
+    if (!busy || _threads.empty())
+    {
+        for (size_t i = 0; i < count; i++)
+            func(i);
+
+        return;
+    }
+
+    {
+        std::scoped_lock lock(_lock);
+        _func = &func;
+        _count = count;
+        _next = 0;
+        _working = _threads.size();
+        _generation++;
+    }
+
+    _wake.notify_all();
+
+    for (size_t i; (i = _next++) < count; )
+        func(i);
+
+    // every worker checks in, even ones that woke too late
+    // to get an index, so none is left looking at `func`.
+    std::unique_lock lock(_lock);
+    _done.wait(lock, [this]() { return !_working; });
+    _func = nullptr;
+}
+
+void ParallelPool::worker()
+{
+    uint64_t generation = 0;
+    std::unique_lock lock(_lock);
+
+    while (true)
+    {
+        _wake.wait(lock, [&]() { return _stop || _generation != generation; });
+
+        if (_stop)
+            return;
+
+        generation = _generation;
+        auto func = _func;
+        size_t count = _count;
+
+        lock.unlock();
+
+        for (size_t i; (i = _next++) < count; )
+            (*func)(i);
+
+        lock.lock();
+
+        if (!--_working)
+            _done.notify_one();
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// worker threads for parallel_for, one per core besides the
+// caller. started on first use and kept until exit; edits run
+// parallel_for often enough (every drag of a frame-range
+// transform, say) that spawning threads each time adds up.
+class ParallelPool
+{
+public:
+    static ParallelPool &get();
+
+    ~ParallelPool();
+
+    // run `func(i)` for every i in [0, count) on the pool and
+    // the calling thread, and wait for them all to finish. if
+    // the pool is already busy (a nested or concurrent call),
+    // this runs on the calling thread alone instead.
+    void run(size_t count, const std::function<void(size_t)> &func);
+
+private:
+    ParallelPool();
+
+    void worker();
+
+    std::vector<std::thread>                _threads;
+    std::mutex                              _busy;
+    std::mutex                              _lock;
+    std::condition_variable                 _wake, _done;
+    const std::function<void(size_t)>       *_func = nullptr;
+    size_t                                  _count = 0;
+    std::atomic_size_t                      _next = 0;
+    size_t                                  _working = 0;
+    uint64_t                                _generation = 0;
+    bool                                    _stop = false;
+};
+
+// run `func(i)` for every i in [0, count) across the available
+// cores, and wait for them all to finish. indices are handed out
+// one at a time, so uneven work (frames with more vertices, say)
+// still balances out. `func` must not throw.
+template<typename F>
+inline void parallel_for(size_t count, F &&func)
+{
+    if (!count)
+        return;
+    else if (count == 1)
+    {
+        func(0);
+        return;
+    }
+
+    ParallelPool::get().run(count, std::ref(func));
+}
@@ -180,6 +180,20 @@ void SettingsContainer::Load()
 				toml::qmdlr::TryLoadMember(node, "RenderParameters", renderParams2D);
 			}
 
+			if (auto node = table["Undo"])
+			{
+				toml::qmdlr::TryLoadMember(node, "MemoryBudget", undoMemoryBudget);
+				toml::qmdlr::TryLoadMember(node, "Journal", undoJournal);
+			}
+
+			if (auto node = table["Export"])
+			{
+				toml::qmdlr::TryLoadMember(node, "CompactMeshes", compactOnExport);
+				toml::qmdlr::TryLoadMember(node, "OptimizeVertexCache", optimizeOnExport);
+				toml::qmdlr::TryLoadMember(node, "RemoveDuplicateFrames", removeDuplicateFramesOnExport);
+				toml::qmdlr::TryLoadMember(node, "DuplicateFrameTolerance", duplicateFrameTolerance);
+			}
+
 			if (auto node = table["Debug"])
 			{
 				toml::qmdlr::TryLoadMember(node, "OpenGLDebug", openGLDebug);
@@ -239,6 +253,20 @@ void SettingsContainer::Save()
 		toml::qmdlr::TrySaveMember(table, "RenderParameters", renderParams2D);
 	}
 
+	if (auto &table = *(*settings.emplace("Undo", toml::table{}).first).second.as_table(); true)
+	{
+		toml::qmdlr::TrySaveMember(table, "MemoryBudget", undoMemoryBudget);
+		toml::qmdlr::TrySaveMember(table, "Journal", undoJournal);
+	}
+
+	if (auto &table = *(*settings.emplace("Export", toml::table{}).first).second.as_table(); true)
+	{
+		toml::qmdlr::TrySaveMember(table, "CompactMeshes", compactOnExport);
+		toml::qmdlr::TrySaveMember(table, "OptimizeVertexCache", optimizeOnExport);
+		toml::qmdlr::TrySaveMember(table, "RemoveDuplicateFrames", removeDuplicateFramesOnExport);
+		toml::qmdlr::TrySaveMember(table, "DuplicateFrameTolerance", duplicateFrameTolerance);
+	}
+
 	if (auto &table = *(*settings.emplace("Debug", toml::table{}).first).second.as_table(); true)
 	{
 		toml::qmdlr::TrySaveMember(table, "OpenGLDebug", openGLDebug);
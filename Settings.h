@@ -264,6 +264,26 @@ struct SettingsContainer
 	int weaponFov = 90;
 	int viewerFov = 45;
 	bool openGLDebug = false;
+	// undo history is trimmed from the oldest state
+	// once it grows past this many megabytes.
+	int undoMemoryBudget = 256;
+	// QIM saves keep the undo history in a journal file next
+	// to the model (<file>.qim.journal), instead of rewriting it
+	// on every save. off by default: the QIM is then no longer
+	// self-contained, and moving it without the journal loads
+	// the model but loses its history.
+	bool undoJournal = false;
+	// exporters drop unused vertices/texcoords and
+	// degenerate triangles from what they write.
+	bool compactOnExport = true;
+	// exporters reorder triangles and vertices
+	// for the GPU's vertex cache.
+	bool optimizeOnExport = true;
+	// exporters leave out frames that duplicate an earlier
+	// one to within this distance; off by default, since
+	// games refer to frames by number.
+	bool removeDuplicateFramesOnExport = false;
+	float duplicateFrameTolerance = 0.0f;
 	KeyShortcutMap shortcuts {
 		{ { SDL_SCANCODE_A }, EventType::SelectAll },
 		{ { SDL_SCANCODE_SLASH }, EventType::SelectNone },
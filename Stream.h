@@ -4,6 +4,8 @@
 #include <ostream>
 #include <iostream>
 #include <bit>
+#include <span>
+#include <streambuf>
 
 // Binary streams; by default, streams use the native endianness
 // (unchanged bytes) but can be changed to a specific endianness
@@ -76,6 +78,42 @@ inline std::ios_base &endianness(std::ios_base &os)
     return os;
 }
 
+// read-only stream buffer over a block of memory that
+// is owned elsewhere; wrap in an std::istream to use the
+// binary readers on data that has already been loaded.
+struct memory_streambuf : public std::streambuf
+{
+    memory_streambuf(std::span<const uint8_t> data)
+    {
+        char *p = const_cast<char *>(reinterpret_cast<const char *>(data.data()));
+        setg(p, p, p + data.size());
+    }
+
+protected:
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        char *base;
+
+        if (dir == std::ios_base::beg)
+            base = eback();
+        else if (dir == std::ios_base::cur)
+            base = gptr();
+        else
+            base = egptr();
+
+        if (base + off < eback() || base + off > egptr())
+            return pos_type(off_type(-1));
+
+        setg(eback(), base + off, egptr());
+        return pos_type(gptr() - eback());
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
 // blank type used for paddings
 template<size_t n>
 struct padding
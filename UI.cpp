@@ -99,6 +99,9 @@ void UI::Draw()
 
     DrawThemeWindows();
     DrawKeyShortcuts();
+    DrawJournalRecovery();
+    DrawUndoInspector();
+    DrawDuplicateFrames();
 }
 
 static std::filesystem::path getDebugPath(std::string_view v)
@@ -401,6 +404,320 @@ void UI::DrawThemeWindows()
     }
 }
 
+void UI::DrawJournalRecovery()
+{
+    if (!undo().RecoverableCount())
+        return;
+
+    if (!ImGui::IsPopupOpen("Recover Unsaved Changes"))
+    {
+        ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+        ImGui::OpenPopup("Recover Unsaved Changes");
+    }
+
+    if (ImGui::BeginPopupModal("Recover Unsaved Changes", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoDocking))
+    {
+        ImGui::Text("The undo journal for this model has %zu changes that were never saved,\nprobably from a session that didn't exit cleanly.", undo().RecoverableCount());
+        ImGui::Text("Recovering replays them onto the saved model.");
+
+        if (ImGui::Button("Recover"))
+        {
+            undo().RecoverJournal();
+            ImGui::CloseCurrentPopup();
+        }
+
+        ImGui::SameLine();
+
+        if (ImGui::Button("Discard"))
+        {
+            undo().DiscardJournal();
+            ImGui::CloseCurrentPopup();
+        }
+
+        ImGui::EndPopup();
+    }
+}
+
+void UI::DrawUndoInspector()
+{
+    if (!_showUndoInspector)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(700, 450), ImGuiCond_FirstUseEver);
+
+    if (!ImGui::Begin("Undo Inspector", &_showUndoInspector))
+    {
+        ImGui::End();
+        return;
+    }
+
+    constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable | ImGuiTableFlags_SizingStretchProp;
+    StackFormat<15> bytes;
+
+    // times are from the last run of each state; zero
+    // means it hasn't been undone/redone/written yet.
+    if (ImGui::CollapsingHeader("States", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        if (ImGui::BeginTable("States", 6, tableFlags | ImGuiTableFlags_ScrollY, ImVec2(0, 200)))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Name");
+            ImGui::TableSetupColumn("Size");
+            ImGui::TableSetupColumn("Undo (us)");
+            ImGui::TableSetupColumn("Redo (us)");
+            ImGui::TableSetupColumn("Write (us)");
+            ImGui::TableSetupColumn("Written");
+            ImGui::TableHeadersRow();
+
+            ImGuiListClipper clipper;
+            clipper.Begin((int) undo().Count());
+
+            while (clipper.Step())
+            {
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                {
+                    // newest first, like the history menu
+                    const UndoRedoState *state = undo().Get(undo().End() - 1 - i);
+                    auto &timings = state->Timings();
+
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    if (state->Handle() >= undo().Pointer())
+                        ImGui::TextDisabled("%s", state->Name());
+                    else
+                        ImGui::TextUnformatted(state->Name());
+                    ImGui::SetItemTooltip("%s", state->Id());
+                    ImGui::TableNextColumn();
+                    FormatByteSize(bytes, state->Size());
+                    ImGui::TextUnformatted(bytes.c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", timings.undo);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", timings.redo);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f", timings.write);
+                    ImGui::TableNextColumn();
+                    FormatByteSize(bytes, timings.written);
+                    ImGui::TextUnformatted(bytes.c_str());
+                }
+            }
+
+            ImGui::EndTable();
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Classes", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        struct ClassRow
+        {
+            size_t              count = 0, size = 0;
+            UndoRedoClassStats  stats;
+        };
+
+        std::map<std::string_view, ClassRow> rows;
+
+        for (UndoRedoHandle h = undo().Begin(); h != undo().End(); h++)
+        {
+            auto &row = rows[undo().Get(h)->Id()];
+            row.count++;
+            row.size += undo().Get(h)->Size();
+        }
+
+        for (auto &[id, stats] : undo().ClassStats())
+            rows[id].stats = stats;
+
+        auto average = [](double total, size_t calls) { return calls ? total / calls : 0.0; };
+
+        if (ImGui::BeginTable("Classes", 7, tableFlags))
+        {
+            ImGui::TableSetupColumn("Class");
+            ImGui::TableSetupColumn("States");
+            ImGui::TableSetupColumn("Size");
+            ImGui::TableSetupColumn("Avg Undo (us)");
+            ImGui::TableSetupColumn("Avg Redo (us)");
+            ImGui::TableSetupColumn("Avg Write (us)");
+            ImGui::TableSetupColumn("Written");
+            ImGui::TableHeadersRow();
+
+            for (auto &[id, row] : rows)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(id.data(), id.data() + id.size());
+                ImGui::TableNextColumn();
+                ImGui::Text("%zu", row.count);
+                ImGui::TableNextColumn();
+                FormatByteSize(bytes, row.size);
+                ImGui::TextUnformatted(bytes.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f (%zu)", average(row.stats.undoTime, row.stats.undoCalls), row.stats.undoCalls);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f (%zu)", average(row.stats.redoTime, row.stats.redoCalls), row.stats.redoCalls);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f (%zu)", average(row.stats.writeTime, row.stats.writeCalls), row.stats.writeCalls);
+                ImGui::TableNextColumn();
+                FormatByteSize(bytes, row.stats.written);
+                ImGui::TextUnformatted(bytes.c_str());
+            }
+
+            ImGui::EndTable();
+        }
+
+        if (ImGui::Button("Reset Timings"))
+            undo().ResetClassStats();
+    }
+
+    if (ImGui::CollapsingHeader("Last QIM Save", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        auto &chunks = model().LastSaveChunks();
+
+        if (chunks.empty())
+            ImGui::TextDisabled("Nothing saved yet.");
+        else if (ImGui::BeginTable("Chunks", 4, tableFlags))
+        {
+            ImGui::TableSetupColumn("Chunk");
+            ImGui::TableSetupColumn("Raw");
+            ImGui::TableSetupColumn("Stored");
+            ImGui::TableSetupColumn("Time (ms)");
+            ImGui::TableHeadersRow();
+
+            size_t rawTotal = 0, storedTotal = 0;
+
+            for (auto &chunk : chunks)
+            {
+                // ids are multi-character literals; most significant byte first
+                char name[5] = { (char) (chunk.id >> 24), (char) (chunk.id >> 16), (char) (chunk.id >> 8), (char) chunk.id, 0 };
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(name);
+                ImGui::TableNextColumn();
+                FormatByteSize(bytes, chunk.rawSize);
+                ImGui::TextUnformatted(bytes.c_str());
+                ImGui::TableNextColumn();
+                FormatByteSize(bytes, chunk.storedSize);
+                ImGui::TextUnformatted(bytes.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", chunk.writeTime / 1000.0f);
+
+                rawTotal += chunk.rawSize;
+                storedTotal += chunk.storedSize;
+            }
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted("Total");
+            ImGui::TableNextColumn();
+            FormatByteSize(bytes, rawTotal);
+            ImGui::TextUnformatted(bytes.c_str());
+            ImGui::TableNextColumn();
+            FormatByteSize(bytes, storedTotal);
+            ImGui::TextUnformatted(bytes.c_str());
+
+            ImGui::EndTable();
+        }
+    }
+
+    ImGui::End();
+}
+
+void UI::DrawDuplicateFrames()
+{
+    if (!_showDuplicateFrames)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(450, 400), ImGuiCond_FirstUseEver);
+
+    if (!ImGui::Begin("Duplicate Frames", &_showDuplicateFrames))
+    {
+        ImGui::End();
+        return;
+    }
+
+    auto &data = model().model();
+
+    // the tolerance is shared with the export option
+    ImGui::SetNextItemWidth(150);
+    if (ImGui::InputFloat("Tolerance", &settings().duplicateFrameTolerance, 0.01f, 0.1f, "%.3f"))
+        settings().duplicateFrameTolerance = std::max(0.0f, settings().duplicateFrameTolerance);
+    ImGui::SameLine();
+    if (ImGui::Button("Analyze"))
+    {
+        _duplicateFrames = FindDuplicateFrames(data.meshes, settings().duplicateFrameTolerance);
+        _duplicateFramesAnalyzed = true;
+    }
+
+    // frames may have been removed since the last analysis
+    std::erase_if(_duplicateFrames, [&](const FrameDuplicate &d) { return d.frame >= data.frames.size(); });
+
+    if (!_duplicateFramesAnalyzed)
+    {
+        ImGui::TextDisabled("Not analyzed yet.");
+        ImGui::End();
+        return;
+    }
+
+    size_t exact = std::count_if(_duplicateFrames.begin(), _duplicateFrames.end(), [](const FrameDuplicate &d) { return d.exact(); });
+    size_t frameSize = 0;
+
+    for (auto &mesh : data.meshes)
+        frameSize += mesh.vertices.size() * sizeof(MeshFrameVertTag);
+
+    StackFormat<15> bytes;
+    FormatByteSize(bytes, frameSize * _duplicateFrames.size());
+    ImGui::Text("%zu of %zu frames are duplicates (%zu exact, %zu near); %s of vertex data.", _duplicateFrames.size(), data.frames.size(), exact, _duplicateFrames.size() - exact, bytes.c_str());
+
+    ImGui::BeginDisabled(_duplicateFrames.empty());
+    if (ImGui::Button("Remove Duplicates"))
+    {
+        model().mutator().removeDuplicateFrames(settings().duplicateFrameTolerance);
+        _duplicateFrames.clear();
+    }
+    ImGui::EndDisabled();
+    ImGui::SetItemTooltip("Games refer to frames by number; removing frames will\nshift every animation after them.");
+
+    constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable | ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_ScrollY;
+
+    if (ImGui::BeginTable("Duplicates", 3, tableFlags))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Frame");
+        ImGui::TableSetupColumn("Duplicate Of");
+        ImGui::TableSetupColumn("Distance");
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int) _duplicateFrames.size());
+
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+            {
+                auto &duplicate = _duplicateFrames[i];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::PushID(i);
+                if (ImGui::Selectable(std::format("{} ({})", data.frames[duplicate.frame].name, duplicate.frame).c_str(), data.selectedFrame == (int32_t) duplicate.frame, ImGuiSelectableFlags_SpanAllColumns))
+                    model().mutator().setSelectedFrame(duplicate.frame);
+                ImGui::PopID();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s (%u)", data.frames[duplicate.original].name.c_str(), duplicate.original);
+                ImGui::TableNextColumn();
+                if (duplicate.exact())
+                    ImGui::TextUnformatted("exact");
+                else
+                    ImGui::Text("%.4f", duplicate.distance);
+            }
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
 void UI::DrawKeyShortcuts()
 {
     if (_showKeyShortcuts)
@@ -641,60 +958,46 @@ void UI::DrawMainMenu()
             // to match other implementations (Blender), the list
             // is of redo states, *not* undo states, so it's slightly
             // different than how `undo` is laid out.
-            // `undo`'s pointer points to the last entry we had undone,
-            // meaning the current state is technically + 1 from the pointers' location.
-            std::optional<UndoRedoStateIterator> activeRedoPointer;
+            // each entry is the pointer we'd move to if clicked; the
+            // state it shows is the one just before that pointer, and
+            // the oldest entry ("Original") has no state at all.
+            std::optional<UndoRedoHandle> switchUndo;
 
-            if (undo().Pointer().has_value())
+            for (UndoRedoHandle p = undo().End(); ; p--)
             {
-                activeRedoPointer = undo().Pointer().value();
-
-                if (activeRedoPointer == undo().List().begin())
-                    activeRedoPointer = std::nullopt;
-                else
-                    (*activeRedoPointer)--;
-            }
-            else if (undo().List().size())
-            {
-                activeRedoPointer = undo().List().end();
-                (*activeRedoPointer)--;
-            }
-
-            std::optional<decltype(undo().List().rbegin())> switchUndo;
-            bool behind = false, clickedBehind = false;
-
-            for (auto it = undo().List().rbegin(); ; ++it)
-            {
-                const char *name;
-
-                if (it == undo().List().rend())
-                    name = "Original";
-                else
-                    name = (*it)->Name();
+                const UndoRedoState *state = (p == undo().Begin()) ? nullptr : undo().Get(p - 1);
+                const char *name = state ? state->Name() : "Original";
 
-                if ((activeRedoPointer.has_value() && it == --decltype(it)(*activeRedoPointer)) ||
-                    (!activeRedoPointer.has_value() && it == undo().List().rend()))
+                if (p == undo().Pointer())
                 {
                     ImGui::BeginDisabled(true);
                     ImGui::BulletText(name);
                     ImGui::EndDisabled();
-                    behind = true;
                 }
                 else
                 {
                     ImGui::SetCursorPosX(ImGui::GetCursorPosX() + ImGui::GetTreeNodeToLabelSpacing());
 
                     if (ImGui::MenuItem(name))
+                        switchUndo = p;
+                }
+
+                if (state && state->Oversized())
+                {
+                    ImGui::SameLine();
+                    ImGui::TextColored(ImVec4(1, 0.6f, 0, 1), "(!)");
+
+                    if (ImGui::BeginItemTooltip())
                     {
-                        clickedBehind = behind;
-                        switchUndo = it;
+                        ImGui::Text("This state is larger than the undo memory budget,\nand will be dropped by the next operation.");
+                        ImGui::EndTooltip();
                     }
                 }
 
-                if (it == undo().List().rend())
+                if (!state)
                     break;
 
-                if (auto combined = dynamic_cast<UndoRedoCombinedState *>(it->get()))
+                if (auto combined = dynamic_cast<const UndoRedoCombinedState *>(state))
                 {
                     if (ImGui::BeginItemTooltip())
                     {
@@ -707,46 +1010,40 @@ void UI::DrawMainMenu()
             }
 
             if (switchUndo)
-            {
-                if (switchUndo == undo().List().rend())
-                    undo().SetPointer(undo().List().begin(), clickedBehind);
-                else
-                    undo().SetPointer(++UndoRedoStateIterator((*switchUndo)->get()->Iterator()), clickedBehind);
-            }
+                undo().SetPointer(*switchUndo);
 
             ImGui::EndMenu();
         }
         ImGui::BeginDisabled(true);
 
-        // TODO split into function
-        StackFormat<15> size;
-        size_t undoSize = undo().Size();
-
-        struct {
-            size_t      ratio;
-            const char  *label;
-        } labels[] = {
-            { 1000000000, "gb" },
-            { 1000000, "mb" },
-            { 1000, "kb" },
-            { 0, "b" }
-        };
+        StackFormat<15> size, budget;
+        FormatByteSize(size, undo().Size());
+        FormatByteSize(budget, undo().Budget());
+
+        ImGui::Text("Undo Memory Used: %s / %s", size.c_str(), budget.c_str());
 
-        for (auto &ratio : labels)
+        if (undo().SpilledCount())
         {
-            if (undoSize >= ratio.ratio)
-            {
-                if (ratio.ratio)
-                    size.Format("{:02} {}", (double) undoSize / ratio.ratio, ratio.label);
-                else
-                    size.Format("{} {}", undoSize, ratio.label);
+            StackFormat<15> spilled;
+            FormatByteSize(spilled, undo().SpilledSize());
+            ImGui::Text("On Disk: %zu states (%s)", undo().SpilledCount(), spilled.c_str());
+        }
 
-                break;
-            }
+        if (undo().CheckpointCount())
+        {
+            StackFormat<15> checkpoints;
+            FormatByteSize(checkpoints, undo().CheckpointSize());
+            ImGui::Text("Checkpoints: %zu (%s)", undo().CheckpointCount(), checkpoints.c_str());
         }
 
-        ImGui::Text("Undo Memory Used: %s", size.c_str());
+        if (undo().EvictedCount())
+        {
+            StackFormat<15> evicted;
+            FormatByteSize(evicted, undo().EvictedSize());
+            ImGui::Text("Dropped: %zu states (%s)", undo().EvictedCount(), evicted.c_str());
+        }
         ImGui::EndDisabled();
+        ImGui::MenuItem("Undo Inspector", nullptr, &_showUndoInspector);
         ImGui::Separator();
         ImGui::MenuItem("Copy", "C");
         ImGui::MenuItem("Paste", "V");
@@ -759,11 +1056,30 @@ void UI::DrawMainMenu()
         ImGui::qmdlr::MenuItemWithEvent("Sync UV/Face Selection", EventType::SyncSelection, EventContext::Any, syncSelection);
         if (ImGui::MenuItem("Key Shortcuts", "C"))
             _showKeyShortcuts = true;
+        ImGui::Separator();
+        ImGui::AlignTextToFramePadding();
+        ImGui::Text("Undo Memory Budget (MB)");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100);
+        if (ImGui::InputInt("##UndoBudget", &settings().undoMemoryBudget, 16, 128))
+        {
+            settings().undoMemoryBudget = std::max(1, settings().undoMemoryBudget);
+            undo().Shrink();
+        }
+        ImGui::MenuItem("Journal Undo History", nullptr, &settings().undoJournal);
+        ImGui::SetItemTooltip("Keep the undo history of QIM files in a journal next to the file;\nsaves only write new changes, and unsaved work can be recovered after a crash.\nThe .journal file has to be kept with the QIM, or its history is lost.");
+        ImGui::MenuItem("Compact Meshes on Export", nullptr, &settings().compactOnExport);
+        ImGui::SetItemTooltip("Leave unused vertices, texcoords and degenerate triangles out of exported models.");
+        ImGui::MenuItem("Optimize Triangle Order on Export", nullptr, &settings().optimizeOnExport);
+        ImGui::SetItemTooltip("Reorder triangles and vertices of exported models so the GPU's vertex cache is used better.");
+        ImGui::MenuItem("Remove Duplicate Frames on Export", nullptr, &settings().removeDuplicateFramesOnExport);
+        ImGui::SetItemTooltip("Leave frames that match an earlier one (within the tolerance set\nin Tools > Duplicate Frames) out of exported models.");
         ImGui::EndMenu();
     }
 
     if (ImGui::BeginMenu("Tools"))
     {
+        ImGui::MenuItem("Duplicate Frames", nullptr, &_showDuplicateFrames);
         ImGui::EndMenu();
     }
 
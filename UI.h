@@ -4,6 +4,7 @@
 #include <filesystem>
 
 #include "Editor3D.h"
+#include "MeshTools.h"
 #include "EditorUV.h"
 #include "MDLRenderer.h"
 #include "Settings.h"
@@ -58,6 +59,16 @@ private:
     bool _showKeyShortcuts = false;
     void DrawKeyShortcuts();
 
+    void DrawJournalRecovery();
+
+    bool _showUndoInspector = false;
+    void DrawUndoInspector();
+
+    bool _showDuplicateFrames = false;
+    bool _duplicateFramesAnalyzed = false;
+    std::vector<FrameDuplicate> _duplicateFrames;
+    void DrawDuplicateFrames();
+
     Editor3D _editor3D;
     EditorUV _editorUV;
 
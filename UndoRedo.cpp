@@ -1,35 +1,94 @@
 #include <imgui.h>
 #include <SDL_assert.h>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <zstd.h>
 
 #include "UndoRedo.h"
 #include "Stream.h"
 #include "ModelLoader.h"
+#include "ModelSnapshot.h"
+#include "Settings.h"
+#include "Format.h"
+#include "Log.h"
+#include "UI.h"
 
-static UndoRedoStorage *head = nullptr;
+// nb: registrations happen during static initialization,
+// so the registry is constructed on first use.
+static std::unordered_map<std::string_view, UndoRedoStorage *> &UndoRedoRegistry()
+{
+	static std::unordered_map<std::string_view, UndoRedoStorage *> registry;
+	return registry;
+}
 
 UndoRedoStorage::UndoRedoStorage(const char *clas, std::function<UndoRedoState *()> factory) :
 	clas(clas),
 	factory(factory)
 {
-	for (UndoRedoStorage *p = head; p; p = p->next)
-		SDL_assert(strcmp(p->clas, clas));
+	[[maybe_unused]] bool inserted = UndoRedoRegistry().try_emplace(clas, this).second;
+	SDL_assert(inserted);
+}
 
-	if (!head)
-		head = this;
-	else
+/*static*/ UndoRedoStorage *UndoRedoStorage::Find(std::string_view name)
+{
+	auto &registry = UndoRedoRegistry();
+
+	if (auto it = registry.find(name); it != registry.end())
+		return it->second;
+
+	return nullptr;
+}
+
+void *UndoRedoArena::Allocate(size_t size)
+{
+	if (size > MAX_BLOCK_SIZE)
+		return ::operator new(size);
+
+	size_t cls = (size - 1) / GRANULARITY;
+
+	if (FreeBlock *block = _free[cls])
 	{
-		next = head;
-		head = this;
+		_free[cls] = block->next;
+		return block;
 	}
+
+	size_t blockSize = (cls + 1) * GRANULARITY;
+
+	if (_chunkUsed + blockSize > CHUNK_SIZE)
+	{
+		_chunks.push_back(std::make_unique<std::byte[]>(CHUNK_SIZE));
+		_chunkUsed = 0;
+	}
+
+	void *ptr = _chunks.back().get() + _chunkUsed;
+	_chunkUsed += blockSize;
+	return ptr;
 }
 
-/*static*/ UndoRedoStorage *UndoRedoStorage::Find(const char *name)
+void UndoRedoArena::Free(void *ptr, size_t size)
 {
-	for (UndoRedoStorage *p = head; p; p = p->next)
-		if (!strcmp(p->clas, name))
-			return p;
+	if (!ptr)
+		return;
+	else if (size > MAX_BLOCK_SIZE)
+	{
+		::operator delete(ptr);
+		return;
+	}
 
-	return nullptr;
+	size_t cls = (size - 1) / GRANULARITY;
+	FreeBlock *block = static_cast<FreeBlock *>(ptr);
+	block->next = _free[cls];
+	_free[cls] = block;
+}
+
+UndoRedoArena &undoArena()
+{
+	// never destroyed; the undo() singleton may release
+	// its states after static destruction has begun.
+	static UndoRedoArena *arena = new UndoRedoArena;
+	return *arena;
 }
 
 REGISTER_UNDO_REDO_ID(UndoRedoCombinedState);
@@ -43,7 +102,13 @@ REGISTER_UNDO_REDO_ID(UndoRedoCombinedState);
 
 	for (size_t i = 0; i < count; i++)
 	{
-		UndoRedoStorage *store = UndoRedoStorage::Find(id.c_str());
+		input >= id;
+
+		UndoRedoStorage *store = UndoRedoStorage::Find(id);
+
+		if (!store)
+			throw std::runtime_error("unknown undo state id");
+
 		UndoRedoState *state = store->factory();
 
 		state->Read(input);
@@ -62,11 +127,276 @@ REGISTER_UNDO_REDO_ID(UndoRedoCombinedState);
 	}
 }
 
+// speed matters more than ratio for undo data; it
+// is compressed while the user is working.
+static std::optional<std::string> CompressUndoData(const std::string &data)
+{
+	std::string compressed(ZSTD_compressBound(data.size()), '\0');
+	size_t compressedSize = ZSTD_compress(compressed.data(), compressed.size(), data.data(), data.size(), 1);
+
+	if (ZSTD_isError(compressedSize))
+		return std::nullopt;
+
+	compressed.resize(compressedSize);
+	return compressed;
+}
+
+static std::optional<std::string> DecompressUndoData(const std::string &compressed, size_t size)
+{
+	std::string data(size, '\0');
+	size_t decompressedSize = ZSTD_decompress(data.data(), data.size(), compressed.data(), compressed.size());
+
+	if (ZSTD_isError(decompressedSize) || decompressedSize != size)
+		return std::nullopt;
+
+	return data;
+}
+
+UndoRedoSpillFile::UndoRedoSpillFile()
+{
+	auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+	_path = std::filesystem::temp_directory_path() / std::format("qmdlr-undo-{:x}-{:x}.spill", stamp, (uintptr_t) this);
+	_stream.open(_path, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+}
+
+UndoRedoSpillFile::~UndoRedoSpillFile()
+{
+	if (!_stream.is_open())
+		return;
+
+	_stream.close();
+
+	std::error_code ec;
+	std::filesystem::remove(_path, ec);
+}
+
+std::optional<UndoRedoSpillFile::Record> UndoRedoSpillFile::Append(const std::string &data)
+{
+	auto compressed = CompressUndoData(data);
+
+	if (!compressed)
+		return std::nullopt;
+
+	_stream.seekp(_end);
+	_stream.write(compressed->data(), compressed->size());
+
+	if (!_stream)
+	{
+		_stream.clear();
+		return std::nullopt;
+	}
+
+	Record record { _end, compressed->size(), data.size() };
+	_end += compressed->size();
+	return record;
+}
+
+std::string UndoRedoSpillFile::Read(const Record &record)
+{
+	std::string compressed(record.compressedSize, '\0');
+	_stream.seekg(record.offset);
+	_stream.read(compressed.data(), compressed.size());
+
+	auto data = _stream ? DecompressUndoData(compressed, record.size) : std::nullopt;
+
+	if (!data)
+		throw std::runtime_error("undo spill file is corrupt");
+
+	return std::move(*data);
+}
+
+UndoRedoState *UndoRedoSpilledState::Load() const
+{
+	std::istringstream stream(_file->Read(_record), std::ios_base::in | std::ios_base::binary);
+	UndoRedoState *state = UndoRedoStorage::Find(_id)->factory();
+	state->Read(stream);
+	return state;
+}
+
+/*virtual*/ void UndoRedoSpilledState::Write(std::ostream &output) const /*override*/
+{
+	std::string data = _file->Read(_record);
+	output.write(data.data(), data.size());
+}
+
+constexpr int32_t JOURNAL_MAGIC = 'QJRN';
+constexpr int32_t JOURNAL_VERSION = 1;
+constexpr size_t JOURNAL_HEADER_SIZE = sizeof(JOURNAL_MAGIC) + sizeof(JOURNAL_VERSION);
+
+UndoRedoJournal::UndoRedoJournal(const std::filesystem::path &path, std::optional<size_t> keep) :
+	_path(path)
+{
+	std::error_code ec;
+
+	// cut off anything past the last good record
+	if (keep && std::filesystem::exists(_path, ec))
+		std::filesystem::resize_file(_path, *keep, ec);
+
+	if (!keep || ec)
+	{
+		_stream.open(_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		_stream <= JOURNAL_MAGIC <= JOURNAL_VERSION;
+		_written = JOURNAL_HEADER_SIZE;
+	}
+	else
+	{
+		_stream.open(_path, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+		_written = *keep;
+	}
+
+	if (!_stream)
+	{
+		_stream.close();
+		return;
+	}
+
+	_thread = std::thread(&UndoRedoJournal::WriterThread, this);
+}
+
+UndoRedoJournal::~UndoRedoJournal()
+{
+	if (!_thread.joinable())
+		return;
+
+	{
+		std::scoped_lock lock(_lock);
+		_stop = true;
+	}
+
+	_wake.notify_one();
+	_thread.join();
+}
+
+void UndoRedoJournal::Append(RecordType type, std::string data)
+{
+	if (!IsOpen())
+		return;
+
+	{
+		std::scoped_lock lock(_lock);
+		_queue.push_back({ type, std::move(data) });
+	}
+
+	_wake.notify_one();
+}
+
+std::optional<size_t> UndoRedoJournal::Flush()
+{
+	if (!IsOpen())
+		return std::nullopt;
+
+	std::unique_lock lock(_lock);
+	_drained.wait(lock, [this] { return _queue.empty() && !_writing; });
+
+	if (_failed)
+		return std::nullopt;
+
+	return _written;
+}
+
+void UndoRedoJournal::WriterThread()
+{
+	std::vector<Record> batch;
+
+	while (true)
+	{
+		{
+			std::unique_lock lock(_lock);
+			_wake.wait(lock, [this] { return _stop || !_queue.empty(); });
+
+			// nb: the queue is drained before stopping
+			if (_queue.empty())
+				break;
+
+			std::swap(batch, _queue);
+			_writing = true;
+		}
+
+		size_t written = 0;
+		bool failed = false;
+
+		for (auto &record : batch)
+		{
+			auto compressed = CompressUndoData(record.data);
+
+			if (!compressed)
+			{
+				failed = true;
+				break;
+			}
+
+			_stream <= record.type <= (uint64_t) record.data.size() <= (uint64_t) compressed->size();
+			_stream.write(compressed->data(), compressed->size());
+			written += sizeof(record.type) + sizeof(uint64_t) * 2 + compressed->size();
+		}
+
+		_stream.flush();
+		failed = failed || !_stream;
+		batch.clear();
+
+		{
+			std::scoped_lock lock(_lock);
+			_written += written;
+			_failed = _failed || failed;
+			_writing = false;
+		}
+
+		_drained.notify_all();
+	}
+}
+
+/*static*/ bool UndoRedoJournal::ReadRecords(const std::filesystem::path &path, size_t committed,
+											 std::vector<Record> &saved, std::vector<Record> &unsaved, size_t &end)
+{
+	std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+
+	int32_t magic = 0, version = 0;
+	stream >= magic >= version;
+
+	if (!stream || magic != JOURNAL_MAGIC || version != JOURNAL_VERSION)
+		return false;
+
+	end = JOURNAL_HEADER_SIZE;
+
+	while (true)
+	{
+		Record record;
+		uint64_t size, compressedSize;
+
+		stream >= record.type >= size >= compressedSize;
+
+		if (!stream)
+			break;
+
+		std::string compressed(compressedSize, '\0');
+		stream.read(compressed.data(), compressed.size());
+
+		if (!stream)
+			break;
+
+		auto data = DecompressUndoData(compressed, size);
+
+		if (!data)
+			break;
+
+		record.data = std::move(*data);
+		end += sizeof(record.type) + sizeof(uint64_t) * 2 + compressedSize;
+
+		if (end <= committed)
+			saved.push_back(std::move(record));
+		else
+			unsaved.push_back(std::move(record));
+	}
+
+	return true;
+}
+
 void UndoRedo::Push(UndoRedoState *state)
 {
 	SDL_assert(UndoRedoStorage::Find(state->Id()));
 
-	if (_disabled)
+	// an open transaction needs every state, to roll back with
+	if (_disabled && !_transaction.depth)
 	{
 		delete state;
 		return;
@@ -78,23 +408,158 @@ void UndoRedo::Push(UndoRedoState *state)
 		return;
 	}
 
+	// a deferred state flushed here is pushed after `state` was
+	// already applied, so the model is ahead of its handle and
+	// it mustn't checkpoint; the check below covers it instead.
+	_pushingDeferred = true;
 	RunDeferred(true);
+	_pushingDeferred = false;
 
-	// if we've moved the pointer, we have to slice off
-	// the list from the pointer forward.
-	if (_pointer)
+	// held until the transaction ends; kept flat, so
+	// undoing it doesn't recurse through nested groups.
+	if (_transaction.depth)
+	{
+		if (auto combined = dynamic_cast<UndoRedoCombinedState *>(state))
+		{
+			for (auto &inner : combined->_states)
+				_transaction.states.Push(std::move(inner));
+
+			delete state;
+		}
+		else
+			_transaction.states.Push(state);
+
+		return;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+
+	// fold quick repeats (nudges, consecutive drags) into
+	// the newest state, if it knows how to absorb them.
+	if (_lastPush && now - *_lastPush <= COALESCE_WINDOW && _pointer == _end && _end != _begin)
 	{
-		_list.erase(*_pointer, _list.end());
-		_pointer = std::nullopt;
+		UndoRedoState *last = Get(_end - 1);
+		size_t lastSize = last->Size();
+
+		if (last->Coalesce(*state))
+		{
+			_size = _size - lastSize + last->Size();
+			delete state;
+
+			// a checkpoint taken right after the merged
+			// state no longer matches it.
+			if (auto it = _checkpoints.find(_end); it != _checkpoints.end())
+			{
+				_checkpointSize -= it->second.data.size();
+				_checkpoints.erase(it);
+			}
+
+			_lastPush = now;
+			JournalState(UndoRedoJournal::RecordType::Replace, *last);
+			Shrink();
+			return;
+		}
 	}
 
-	state->_iterator = _list.insert(_list.end(), UndoRedoStatePtr(state));
+	_lastPush = now;
+
+	// if we've moved the pointer, we have to slice off
+	// the history from the pointer forward.
+	Erase(_pointer, _end);
+
+	Append(state);
+	_pointer = _end;
+
+	JournalState(UndoRedoJournal::RecordType::Push, *state);
+
+	// nb: states are pushed after being applied, so
+	// the model matches the new pointer.
+	UndoRedoHandle lastCheckpoint = _checkpoints.empty() ? _begin : _checkpoints.rbegin()->first;
+
+	if (!_pushingDeferred && _end - lastCheckpoint >= CHECKPOINT_INTERVAL)
+		TakeCheckpoint();
+
+	// too big to ever fit; keep it so the operation can
+	// still be undone, but let the user know it won't last.
+	if (state->Size() > Budget())
+	{
+		state->_oversized = true;
+
+		StackFormat<32> stateSize, budgetSize;
+		FormatByteSize(stateSize, state->Size());
+		FormatByteSize(budgetSize, Budget());
+		logger().AddLog("Undo state \"{}\" ({}) exceeds the undo memory budget ({}); it will be moved out of memory by the next operation.", state->Name(), stateSize.c_str(), budgetSize.c_str());
+	}
 
 	Shrink();
+}
+
+void UndoRedo::Append(UndoRedoState *state)
+{
+	if (Count() == _ring.size())
+	{
+		std::vector<UndoRedoStatePtr> grown(std::max((size_t) 16, _ring.size() * 2));
+
+		for (UndoRedoHandle h = _begin; h != _end; h++)
+			grown[(size_t) h & (grown.size() - 1)] = std::move(_ring[Slot(h)]);
+
+		_ring = std::move(grown);
+	}
+
+	state->_handle = _end;
+	_ring[Slot(_end)] = UndoRedoStatePtr(state);
+	_end++;
 
 	_size += state->Size();
 }
 
+void UndoRedo::Erase(UndoRedoHandle first, UndoRedoHandle last)
+{
+	SDL_assert(first == _begin || last == _end);
+
+	for (UndoRedoHandle h = first; h != last; h++)
+	{
+		auto &slot = _ring[Slot(h)];
+
+		_size -= slot->Size();
+
+		if (slot->IsSpilled())
+		{
+			auto spilled = static_cast<UndoRedoSpilledState *>(slot.get());
+			_spilledCount--;
+			_spilledSize -= spilled->SpillRecord().compressedSize;
+		}
+
+		slot.reset();
+	}
+
+	// a checkpoint at handle h is the model with the pointer at h.
+	// truncating the tail from `first` reuses every handle after
+	// it, so those checkpoints have to go; the one at `first`
+	// still matches, since none of the erased states are applied.
+	// checkpoints before an evicted head are unreachable.
+	for (auto it = _checkpoints.begin(); it != _checkpoints.end(); )
+	{
+		if ((last == _end) ? (it->first > first) : (it->first < last))
+		{
+			_checkpointSize -= it->second.data.size();
+			it = _checkpoints.erase(it);
+		}
+		else
+			++it;
+	}
+
+	if (last == _end)
+		_end = first;
+	else
+		_begin = last;
+}
+
+size_t UndoRedo::Budget() const
+{
+	return (size_t) std::max(1, settings().undoMemoryBudget) * 1024 * 1024;
+}
+
 // potentially combine multiple pushes into one state
 void UndoRedo::BeginCombined()
 {
@@ -107,7 +572,7 @@ void UndoRedo::EndCombined()
 {
 	_combining = false;
 	
-	if (_disabled)
+	if (_disabled && !_transaction.depth)
 		_combinedTemp = {};
 	else
 	{
@@ -127,7 +592,103 @@ void UndoRedo::Clear()
 
 void UndoRedo::Shrink()
 {
-	// todo
+	size_t budget = Budget();
+
+	// checkpoints are only a shortcut; they go first.
+	while (_size + _checkpointSize > budget && !_checkpoints.empty())
+	{
+		_checkpointSize -= _checkpoints.begin()->second.data.size();
+		_checkpoints.erase(_checkpoints.begin());
+	}
+
+	if (_size <= budget)
+		return;
+
+	if (!_spill)
+	{
+		_spill = std::make_unique<UndoRedoSpillFile>();
+
+		if (!_spill->IsOpen())
+			logger().AddLog("Couldn't create the undo spill file; old undo states will be dropped instead.");
+	}
+
+	// spill states furthest from the pointer first. the states
+	// right on either side of the pointer are kept in memory,
+	// so a single undo or redo never touches the disk.
+	if (_spill->IsOpen())
+	{
+		std::vector<std::pair<UndoRedoHandle, UndoRedoHandle>> victims;
+
+		for (UndoRedoHandle h = _begin; h != _end; h++)
+		{
+			UndoRedoHandle distance = (h < _pointer) ? (_pointer - h) : (h - _pointer + 1);
+
+			if (distance <= 1 || Get(h)->IsSpilled())
+				continue;
+
+			victims.emplace_back(distance, h);
+		}
+
+		std::sort(victims.begin(), victims.end(), std::greater<>());
+
+		for (auto &[distance, h] : victims)
+			if (_size <= budget || !Spill(h))
+				break;
+	}
+
+	// never drop the newest state, even if it's oversized,
+	// and never drop states that are waiting to be redone.
+	while (_size > budget && Count() > 1 && _pointer != _begin)
+	{
+		_evictedCount++;
+		_evictedSize += Get(_begin)->Size();
+		Erase(_begin, _begin + 1);
+	}
+}
+
+bool UndoRedo::Spill(UndoRedoHandle handle)
+{
+	auto &slot = _ring[Slot(handle)];
+
+	std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+	RunWrite(*slot, stream);
+
+	auto record = _spill->Append(stream.str());
+
+	if (!record)
+		return false;
+
+	auto spilled = new UndoRedoSpilledState(*slot, *_spill, *record);
+	spilled->_handle = handle;
+	spilled->_timings = slot->_timings;
+
+	_size -= slot->Size();
+	_size += spilled->Size();
+	_spilledCount++;
+	_spilledSize += record->compressedSize;
+
+	slot = UndoRedoStatePtr(spilled);
+	return true;
+}
+
+void UndoRedo::Fault(UndoRedoHandle handle)
+{
+	auto &slot = _ring[Slot(handle)];
+	if (!slot->IsSpilled())
+		return;
+
+	auto spilled = static_cast<UndoRedoSpilledState *>(slot.get());
+
+	UndoRedoState *state = spilled->Load();
+	state->_handle = handle;
+	state->_timings = spilled->_timings;
+
+	_size -= spilled->Size();
+	_size += state->Size();
+	_spilledCount--;
+	_spilledSize -= spilled->SpillRecord().compressedSize;
+
+	slot = UndoRedoStatePtr(state);
 }
 
 void UndoRedo::Undo()
@@ -135,14 +696,17 @@ void UndoRedo::Undo()
 	if (!CanUndo())
 		return;
 
+	_lastPush = std::nullopt;
+
 	RunDeferred(true);
 
-	if (!_pointer.has_value())
-		_pointer = --_list.end();
-	else
-		(*_pointer)--;
+	_pointer--;
 
-	(*_pointer)->get()->Undo(model().mutator().data);
+	Fault(_pointer);
+	RunUndo(*Get(_pointer), model().mutator().data);
+
+	JournalPointer();
+	Shrink();
 }
 
 void UndoRedo::Redo()
@@ -150,45 +714,122 @@ void UndoRedo::Redo()
 	if (!CanRedo())
 		return;
 
+	_lastPush = std::nullopt;
+
 	RunDeferred(true);
 
-	(*_pointer)->get()->Redo(model().mutator().data);
+	Fault(_pointer);
+	RunRedo(*Get(_pointer), model().mutator().data);
 
-	(*_pointer)++;
+	_pointer++;
 
-	if (_pointer == _list.end())
-		_pointer = std::nullopt;
+	JournalPointer();
+	Shrink();
 }
 
-// change the pointer to the given iterator
-void UndoRedo::SetPointer(UndoRedoStateIterator it, bool ahead)
+// change the pointer to the given handle
+void UndoRedo::SetPointer(UndoRedoHandle handle)
 {
-	if (it == _pointer)
+	SDL_assert(handle >= _begin && handle <= _end);
+
+	if (handle == _pointer)
 		return;
 
-	auto current_it = _pointer.value_or(_list.end());
-	auto distance = ahead ? 
-		std::distance(it, current_it) :
-		std::distance(current_it, it);
+	_lastPush = std::nullopt;
+
+	// nb: the renderer only flags its buffers here, so however
+	// many states are replayed, it rebuilds once on the next draw.
+	if (auto checkpoint = FindCheckpoint(handle))
+		RestoreCheckpoint(*checkpoint);
 
-	if (!ahead)
+	while (_pointer < handle)
 	{
-		for (auto i = current_it; i != it; i++)
-		{
-			(*i)->Redo(model().mutator().data);
-		}
+		Fault(_pointer);
+		RunRedo(*Get(_pointer), model().mutator().data);
+		_pointer++;
 	}
-	else
+
+	while (_pointer > handle)
 	{
-		for (auto i = --current_it; i != it; i--)
+		_pointer--;
+		Fault(_pointer);
+		RunUndo(*Get(_pointer), model().mutator().data);
+	}
+
+	JournalPointer();
+	Shrink();
+}
+
+void UndoRedo::TakeCheckpoint()
+{
+	const ModelData *data = model().mutator().data;
+
+	std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+	stream <= data->frames <= data->meshes <= data->selectedFrame <= data->selectedMesh;
+
+	std::string raw = stream.str();
+	auto compressed = CompressUndoData(raw);
+
+	if (!compressed)
+		return;
+
+	_checkpointSize += compressed->size();
+	_checkpoints[_pointer] = { std::move(*compressed), raw.size() };
+}
+
+std::optional<UndoRedoHandle> UndoRedo::FindCheckpoint(UndoRedoHandle target) const
+{
+	auto distance = [](UndoRedoHandle a, UndoRedoHandle b) { return (a > b) ? (a - b) : (b - a); };
+
+	std::optional<UndoRedoHandle> best;
+	UndoRedoHandle bestCost = distance(_pointer, target);
+
+	for (auto &[handle, checkpoint] : _checkpoints)
+	{
+		UndoRedoHandle cost = distance(handle, target) + CHECKPOINT_RESTORE_COST;
+
+		if (cost >= bestCost)
+			continue;
+
+		// everything between the pointer and the checkpoint is
+		// skipped, so it must all be covered by the checkpoint.
+		bool usable = true;
+
+		for (UndoRedoHandle h = std::min(_pointer, handle); h != std::max(_pointer, handle); h++)
 		{
-			(*i)->Undo(model().mutator().data);
+			if (!Get(h)->Checkpointable())
+			{
+				usable = false;
+				break;
+			}
 		}
 
-		(*it)->Undo(model().mutator().data);
+		if (!usable)
+			continue;
+
+		best = handle;
+		bestCost = cost;
 	}
 
-	_pointer = it;
+	return best;
+}
+
+void UndoRedo::RestoreCheckpoint(UndoRedoHandle handle)
+{
+	auto &checkpoint = _checkpoints.at(handle);
+	auto raw = DecompressUndoData(checkpoint.data, checkpoint.size);
+
+	if (!raw)
+		return;
+
+	ModelData *data = model().mutator().data;
+
+	std::istringstream stream(std::move(*raw), std::ios_base::in | std::ios_base::binary);
+	stream >= data->frames >= data->meshes >= data->selectedFrame >= data->selectedMesh;
+
+	_pointer = handle;
+
+	ui().editor3D().renderer().markBufferDirty();
 }
 
 void UndoRedo::RunDeferred(bool force)
@@ -219,52 +860,420 @@ void UndoRedo::Write(std::ostream &stream)
 {
 	RunDeferred(true);
 
-	stream <= _list.size();
+	std::vector<std::string_view> ids;
+	std::unordered_map<std::string_view, uint32_t> idIndices;
+
+	for (UndoRedoHandle h = _begin; h != _end; h++)
+		if (auto [it, inserted] = idIndices.try_emplace(Get(h)->Id(), (uint32_t) ids.size()); inserted)
+			ids.push_back(it->first);
+
+	stream <= ids.size();
 
-	for (auto &entry : _list)
+	for (auto &id : ids)
+		stream <= id.data();
+
+	stream <= Count();
+
+	for (UndoRedoHandle h = _begin; h != _end; h++)
 	{
-		stream <= entry->Id();
-		entry->Write(stream);
+		stream <= idIndices.at(Get(h)->Id());
+		RunWrite(*Get(h), stream);
 	}
 
-	if (!_pointer)
+	if (_pointer == _end)
 		stream <= false;
 	else
 	{
 		stream <= true;
-		stream <= std::distance(_list.begin(), _pointer.value());
+		stream <= (ptrdiff_t) (_pointer - _begin);
 	}
 }
 
-void UndoRedo::Read(std::istream &stream)
+void UndoRedo::Read(std::istream &stream, bool idTable)
 {
+	std::string id;
+	std::vector<UndoRedoStorage *> stores;
+
+	auto find = [](const std::string &id) {
+		UndoRedoStorage *store = UndoRedoStorage::Find(id);
+
+		if (!store)
+			throw std::runtime_error("unknown undo state id");
+
+		return store;
+	};
+
+	if (idTable)
+	{
+		size_t numIds;
+		stream >= numIds;
+
+		stores.reserve(numIds);
+
+		for (size_t i = 0; i < numIds; i++)
+		{
+			stream >= id;
+			stores.push_back(find(id));
+		}
+	}
+
 	size_t count;
 	stream >= count;
 
-	std::string id;
-
+	// nb: states are inserted directly; the pointer
+	// has to be restored before anything can be evicted.
 	for (size_t i = 0; i < count; i++)
 	{
-		stream >= id;
+		UndoRedoStorage *store;
+
+		if (idTable)
+		{
+			uint32_t index;
+			stream >= index;
+			store = stores.at(index);
+		}
+		else
+		{
+			stream >= id;
+			store = find(id);
+		}
 
-		UndoRedoStorage *store = UndoRedoStorage::Find(id.c_str());
 		UndoRedoState *state = store->factory();
 
 		state->Read(stream);
-		Push(state);
+		Append(state);
 	}
 
 	bool has_ptr;
 	stream >= has_ptr;
 
+	_pointer = _end;
+
 	if (has_ptr)
 	{
 		ptrdiff_t dist;
 		stream >= dist;
 
-		_pointer = _list.begin();
-		std::advance(_pointer.value(), dist);
+		_pointer = _begin + dist;
+	}
+
+	Shrink();
+}
+
+void UndoRedo::ReplaceState(UndoRedoHandle handle, UndoRedoState *state)
+{
+	auto &slot = _ring[Slot(handle)];
+
+	_size -= slot->Size();
+
+	if (slot->IsSpilled())
+	{
+		auto spilled = static_cast<UndoRedoSpilledState *>(slot.get());
+		_spilledCount--;
+		_spilledSize -= spilled->SpillRecord().compressedSize;
+	}
+
+	if (auto it = _checkpoints.find(handle + 1); it != _checkpoints.end())
+	{
+		_checkpointSize -= it->second.data.size();
+		_checkpoints.erase(it);
+	}
+
+	state->_handle = handle;
+	slot = UndoRedoStatePtr(state);
+
+	_size += state->Size();
+}
+
+using UndoRedoClock = std::chrono::high_resolution_clock;
+
+static float MicrosecondsSince(UndoRedoClock::time_point start)
+{
+	return std::chrono::duration<float, std::micro>(UndoRedoClock::now() - start).count();
+}
+
+void UndoRedo::RunUndo(UndoRedoState &state, ModelData *data)
+{
+	auto start = UndoRedoClock::now();
+	state.Undo(data);
+	state._timings.undo = MicrosecondsSince(start);
+
+	auto &stats = _classStats[state.Id()];
+	stats.undoCalls++;
+	stats.undoTime += state._timings.undo;
+}
+
+void UndoRedo::RunRedo(UndoRedoState &state, ModelData *data)
+{
+	auto start = UndoRedoClock::now();
+	state.Redo(data);
+	state._timings.redo = MicrosecondsSince(start);
+
+	auto &stats = _classStats[state.Id()];
+	stats.redoCalls++;
+	stats.redoTime += state._timings.redo;
+}
+
+void UndoRedo::RunWrite(const UndoRedoState &state, std::ostream &stream)
+{
+	std::streamoff offset = stream.tellp();
+	auto start = UndoRedoClock::now();
+	state.Write(stream);
+	state._timings.write = MicrosecondsSince(start);
+
+	// nb: tellp fails on some streams; size is just unknown then
+	if (std::streamoff end = stream.tellp(); offset >= 0 && end >= offset)
+		state._timings.written = (size_t) (end - offset);
+
+	auto &stats = _classStats[state.Id()];
+	stats.writeCalls++;
+	stats.writeTime += state._timings.write;
+	stats.written += state._timings.written;
+}
+
+void UndoRedo::JournalState(UndoRedoJournal::RecordType type, const UndoRedoState &state)
+{
+	if (!_journal)
+		return;
+
+	std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+	stream <= state.Id();
+	RunWrite(state, stream);
+
+	_journal->Append(type, stream.str());
+	_journalRecords++;
+}
+
+void UndoRedo::JournalPointer()
+{
+	if (!_journal)
+		return;
+
+	std::ostringstream stream(std::ios_base::out | std::ios_base::binary);
+	stream <= (uint64_t) (_pointer - _journalBase);
+
+	_journal->Append(UndoRedoJournal::RecordType::Pointer, stream.str());
+	_journalRecords++;
+}
+
+void UndoRedo::ApplyJournalRecord(const UndoRedoJournal::Record &record, bool applyToModel)
+{
+	std::istringstream stream(record.data, std::ios_base::in | std::ios_base::binary);
+
+	if (record.type == UndoRedoJournal::RecordType::Pointer)
+	{
+		uint64_t index;
+		stream >= index;
+
+		// states may have been evicted since
+		UndoRedoHandle handle = std::clamp(_journalBase + index, _begin, _end);
+
+		if (applyToModel)
+			SetPointer(handle);
+		else
+			_pointer = handle;
+
+		return;
 	}
+
+	std::string id;
+	stream >= id;
+
+	UndoRedoStorage *store = UndoRedoStorage::Find(id);
+
+	if (!store)
+		throw std::runtime_error("unknown undo state id");
+
+	UndoRedoState *state = store->factory();
+	state->Read(stream);
+
+	ModelData *data = model().mutator().data;
+
+	if (record.type == UndoRedoJournal::RecordType::Push)
+	{
+		Erase(_pointer, _end);
+
+		if (applyToModel)
+			RunRedo(*state, data);
+
+		Append(state);
+		_pointer = _end;
+	}
+	else if (_begin == _end)
+		delete state;
+	else
+	{
+		UndoRedoHandle newest = _end - 1;
+
+		// the newest state was replaced by a merged one
+		// that starts from the same data.
+		if (applyToModel && _pointer == _end)
+		{
+			Fault(newest);
+			RunUndo(*Get(newest), data);
+			RunRedo(*state, data);
+		}
+
+		ReplaceState(newest, state);
+	}
+}
+
+bool UndoRedo::StartJournal(const std::filesystem::path &path)
+{
+	RunDeferred(true);
+
+	_journalTail.clear();
+	_journal = std::make_unique<UndoRedoJournal>(path, std::nullopt);
+
+	if (!_journal->IsOpen())
+	{
+		logger().AddLog("Couldn't create undo journal {}.", path.string());
+		_journal.reset();
+		return false;
+	}
+
+	_journalBase = _begin;
+	_journalRecords = 0;
+
+	for (UndoRedoHandle h = _begin; h != _end; h++)
+		JournalState(UndoRedoJournal::RecordType::Push, *Get(h));
+
+	JournalPointer();
+	return true;
+}
+
+bool UndoRedo::OpenJournal(const std::filesystem::path &path, size_t committed)
+{
+	std::vector<UndoRedoJournal::Record> saved;
+
+	_journalTail.clear();
+
+	if (!UndoRedoJournal::ReadRecords(path, committed, saved, _journalTail, _journalEnd))
+	{
+		logger().AddLog("Undo journal {} is missing or invalid; history was not restored.", path.string());
+		return false;
+	}
+
+	_journalBase = _begin;
+
+	// the saved model already reflects these. the journal can hold
+	// far more than the budget allows, so keep shrinking as we go.
+	for (auto &record : saved)
+	{
+		ApplyJournalRecord(record, false);
+		Shrink();
+	}
+
+	_journalPath = path;
+	_journalCommitted = committed;
+	_journalRecords = saved.size();
+
+	if (_journalTail.empty())
+		_journal = std::make_unique<UndoRedoJournal>(path, _journalEnd);
+
+	Shrink();
+	return true;
+}
+
+std::optional<size_t> UndoRedo::CommitJournal()
+{
+	if (!_journal)
+		return std::nullopt;
+
+	RunDeferred(true);
+
+	if (_journalRecords >= JOURNAL_COMPACT_MIN && _journalRecords > (Count() + 1) * JOURNAL_COMPACT_RATIO)
+		CompactJournal();
+
+	if (!_journal)
+		return std::nullopt;
+
+	return _journal->Flush();
+}
+
+void UndoRedo::CompactJournal()
+{
+	auto path = _journal->Path();
+	auto compacted = std::filesystem::path(path).concat(".tmp");
+	auto old = std::move(_journal);
+	auto oldBase = _journalBase;
+	auto oldRecords = _journalRecords;
+
+	std::optional<size_t> size;
+
+	if (StartJournal(compacted))
+		size = _journal->Flush();
+
+	_journal.reset();
+
+	std::error_code ec;
+
+	if (!size)
+	{
+		logger().AddLog("Couldn't compact undo journal {}; keeping the old one.", path.string());
+		std::filesystem::remove(compacted, ec);
+
+		_journalBase = oldBase;
+		_journalRecords = oldRecords;
+		_journal = std::move(old);
+		return;
+	}
+
+	auto oldSize = old->Flush();
+	old.reset();
+
+	std::filesystem::rename(compacted, path, ec);
+
+	if (ec)
+	{
+		logger().AddLog("Couldn't replace undo journal {}: {}", path.string(), ec.message());
+		std::filesystem::remove(compacted, ec);
+
+		_journalBase = oldBase;
+		_journalRecords = oldRecords;
+
+		// the old one is still intact up to where it was written
+		if (oldSize)
+			_journal = std::make_unique<UndoRedoJournal>(path, oldSize);
+
+		return;
+	}
+
+	_journal = std::make_unique<UndoRedoJournal>(path, size);
+}
+
+void UndoRedo::RecoverJournal()
+{
+	size_t recovered = 0;
+
+	try
+	{
+		for (auto &record : _journalTail)
+		{
+			ApplyJournalRecord(record, true);
+			Shrink();
+			recovered++;
+		}
+	}
+	catch (const std::exception &e)
+	{
+		logger().AddLog("Undo journal recovery stopped: {}", e.what());
+	}
+
+	logger().AddLog("Recovered {} of {} unsaved undo journal records.", recovered, _journalTail.size());
+
+	_journalRecords += _journalTail.size();
+	_journalTail.clear();
+	_journal = std::make_unique<UndoRedoJournal>(_journalPath, _journalEnd);
+
+	ui().editor3D().renderer().markBufferDirty();
+	Shrink();
+}
+
+void UndoRedo::DiscardJournal()
+{
+	_journalTail.clear();
+	_journal = std::make_unique<UndoRedoJournal>(_journalPath, _journalCommitted);
 }
 
 UndoRedo &undo()
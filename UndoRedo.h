@@ -1,18 +1,87 @@
 #pragma once
 
 #include <iostream>
-#include <list>
+#include <vector>
+#include <map>
 #include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <optional>
 #include <functional>
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
 
 class ModelData;
+class ModelSnapshot;
 
 using UndoRedoStatePtr = std::unique_ptr<class UndoRedoState>;
-using UndoRedoStateList = std::list<UndoRedoStatePtr>;
-using UndoRedoStateIterator = typename UndoRedoStateList::iterator;
-using UndoRedoStatePointer = std::optional<UndoRedoStateIterator>;
+
+// handle to a state in the undo history. handles are handed
+// out in push order and stay valid (and comparable) while
+// older states are dropped. truncating the redo tail hands
+// its handles out again, so anything keyed by handle past
+// the truncation point must be dropped along with it.
+using UndoRedoHandle = uint64_t;
+
+// pool for undo state objects; states are small, fixed-size
+// headers (their data lives in their own vectors), so they
+// are carved out of shared chunks and recycled through
+// per-size free lists instead of hitting the heap on every push.
+// nb: not thread safe; states are only created and destroyed
+// on the main thread.
+class UndoRedoArena
+{
+public:
+	UndoRedoArena() = default;
+	UndoRedoArena(const UndoRedoArena &) = delete;
+	UndoRedoArena &operator=(const UndoRedoArena &) = delete;
+
+	void *Allocate(size_t size);
+	void Free(void *ptr, size_t size);
+
+	// bytes reserved in chunks
+	size_t Reserved() const { return _chunks.size() * CHUNK_SIZE; }
+
+private:
+	static constexpr size_t GRANULARITY = 16;
+	static constexpr size_t MAX_BLOCK_SIZE = 512;
+	static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+	struct FreeBlock
+	{
+		FreeBlock *next;
+	};
+
+	std::vector<std::unique_ptr<std::byte[]>> _chunks;
+	size_t _chunkUsed = CHUNK_SIZE;
+	FreeBlock *_free[MAX_BLOCK_SIZE / GRANULARITY] {};
+};
+
+UndoRedoArena &undoArena();
+
+// how long the last run of a state took, in microseconds,
+// and how many bytes its last Write produced.
+struct UndoRedoTimings
+{
+	float	undo = 0, redo = 0, write = 0;
+	size_t	written = 0;
+};
+
+// running totals for every state of one class, including
+// those that have since left the history.
+struct UndoRedoClassStats
+{
+	size_t	undoCalls = 0, redoCalls = 0, writeCalls = 0;
+	double	undoTime = 0, redoTime = 0, writeTime = 0;
+	size_t	written = 0;
+};
 
 // base abstract class for undo/redo operations.
 class UndoRedoState
@@ -24,6 +93,9 @@ public:
 
 	UndoRedoState &operator=(UndoRedoState &&) = default;
 
+	static void *operator new(size_t size) { return undoArena().Allocate(size); }
+	static void operator delete(void *ptr, size_t size) { undoArena().Free(ptr, size); }
+
 	virtual void Undo(ModelData *data) = 0;
 
 	virtual void Redo(ModelData *data) = 0;
@@ -40,12 +112,35 @@ public:
 	// buffer size spillage, and for serialization.
 	virtual size_t Size() const = 0;
 
-	inline const UndoRedoStateIterator &Iterator() const { return _iterator; }
+	inline UndoRedoHandle Handle() const { return _handle; }
 
 	virtual const char *Id() const = 0;
 
+	// true if this state alone is larger than the undo
+	// memory budget; it will be evicted as soon as
+	// another state is pushed.
+	inline bool Oversized() const { return _oversized; }
+
+	// true if this state only touches data captured by undo
+	// checkpoints (frames, meshes and their selection); long
+	// history jumps may skip over it by restoring a checkpoint.
+	virtual bool Checkpointable() const { return false; }
+
+	// true if this state's data lives in the spill file.
+	virtual bool IsSpilled() const { return false; }
+
+	// try to absorb `next`, which was pushed right after this
+	// state and has already been applied. returns true if this
+	// state now covers both and `next` can be discarded.
+	virtual bool Coalesce(const UndoRedoState &next) { return false; }
+
+	inline const UndoRedoTimings &Timings() const { return _timings; }
+
 protected:
-	UndoRedoStateIterator _iterator;
+	UndoRedoHandle _handle = 0;
+	bool _oversized = false;
+	// nb: mutable since writing a state is timed too
+	mutable UndoRedoTimings _timings;
 
 	friend class UndoRedo;
 };
@@ -58,9 +153,8 @@ public:
 	const char *clas;
 	std::function<UndoRedoState *()> factory;
 
-	UndoRedoStorage *next = nullptr;
-
-	static UndoRedoStorage *Find(const char *name);
+	// hashed lookup by class name; null if not registered
+	static UndoRedoStorage *Find(std::string_view name);
 };
 
 #define SET_UNDO_REDO_ID(clas) \
@@ -117,6 +211,15 @@ public:
 		Push(state.release());
 	}
 
+	virtual bool Checkpointable() const override
+	{
+		for (auto &state : _states)
+			if (!state->Checkpointable())
+				return false;
+
+		return true;
+	}
+
 	SET_UNDO_REDO_ID(UndoRedoCombinedState)
 
 	const auto &getStates() const { return _states; }
@@ -128,15 +231,203 @@ protected:
 	friend class UndoRedo;
 };
 
+// append-only, zstd-compressed file that holds undo states
+// which have been pushed out of memory. it is removed when
+// the history is cleared or the program exits.
+class UndoRedoSpillFile
+{
+public:
+	struct Record
+	{
+		std::streamoff	offset;
+		size_t			compressedSize;
+		size_t			size;
+	};
+
+	UndoRedoSpillFile();
+	~UndoRedoSpillFile();
+
+	bool IsOpen() const { return _stream.is_open(); }
+
+	// compress and append the serialized state
+	std::optional<Record> Append(const std::string &data);
+
+	// read back and decompress a record
+	std::string Read(const Record &record);
+
+	// bytes in the file, including space held by records
+	// that have since been faulted back in
+	size_t FileSize() const { return _end; }
+
+private:
+	std::filesystem::path	_path;
+	std::fstream			_stream;
+	std::streamoff			_end = 0;
+};
+
+// stand-in for a state that lives in the spill file; holds
+// just enough to show it in the history and save it.
+class UndoRedoSpilledState : public UndoRedoState
+{
+public:
+	UndoRedoSpilledState(const UndoRedoState &state, UndoRedoSpillFile &file, const UndoRedoSpillFile::Record &record) :
+		_name(state.Name()),
+		_id(state.Id()),
+		_checkpointable(state.Checkpointable()),
+		_file(&file),
+		_record(record)
+	{
+	}
+
+	// load the real state back from disk
+	UndoRedoState *Load() const;
+
+	// nb: UndoRedo faults states in before running them;
+	// these are only here as a fallback.
+	virtual void Undo(ModelData *data) override
+	{
+		std::unique_ptr<UndoRedoState>(Load())->Undo(data);
+	}
+
+	virtual void Redo(ModelData *data) override
+	{
+		std::unique_ptr<UndoRedoState>(Load())->Redo(data);
+	}
+
+	virtual const char *Name() const override { return _name.c_str(); }
+
+	// spilled states are never read directly; the
+	// original id is written, so they load as the real thing.
+	virtual void Read(std::istream &input) override { }
+
+	// writes the original state's data, without
+	// having to instantiate it.
+	virtual void Write(std::ostream &output) const override;
+
+	virtual size_t Size() const override
+	{
+		return sizeof(*this) + _name.size();
+	}
+
+	virtual const char *Id() const override { return _id; }
+
+	virtual bool Checkpointable() const override { return _checkpointable; }
+
+	virtual bool IsSpilled() const override { return true; }
+
+	const UndoRedoSpillFile::Record &SpillRecord() const { return _record; }
+
+private:
+	std::string					_name;
+	const char					*_id;
+	bool						_checkpointable;
+	UndoRedoSpillFile			*_file;
+	UndoRedoSpillFile::Record	_record;
+};
+
+// append-only log of changes to the undo history, kept next to
+// a saved QIM. records are compressed and written on a background
+// thread, so saving only has to wait for the queue to drain.
+// records past the offset stored in the QIM were never saved,
+// and can be replayed to recover that work.
+class UndoRedoJournal
+{
+public:
+	enum class RecordType : uint8_t
+	{
+		Push,		// id + state data; truncates the redo tail
+		Replace,	// id + state data; replaces the newest state
+		Pointer		// new pointer, relative to the first state
+	};
+
+	struct Record
+	{
+		RecordType	type;
+		std::string	data;
+	};
+
+	// open `path` for appending. if `keep` is set, the file is cut
+	// to that many bytes and appended to; otherwise it's replaced.
+	UndoRedoJournal(const std::filesystem::path &path, std::optional<size_t> keep);
+	~UndoRedoJournal();
+
+	bool IsOpen() const { return _stream.is_open(); }
+	const std::filesystem::path &Path() const { return _path; }
+
+	// queue a record to be written
+	void Append(RecordType type, std::string data);
+
+	// wait for queued records to be written; returns the
+	// journal's size, or nullopt if writing failed.
+	std::optional<size_t> Flush();
+
+	// read the records in `path`; those that end at or before
+	// `committed` go into `saved`, the rest into `unsaved`. a torn
+	// record at the end is ignored; `end` is where the last good one ends.
+	static bool ReadRecords(const std::filesystem::path &path, size_t committed,
+							std::vector<Record> &saved, std::vector<Record> &unsaved, size_t &end);
+
+private:
+	void WriterThread();
+
+	std::filesystem::path	_path;
+	std::ofstream			_stream;
+
+	std::thread				_thread;
+	std::mutex				_lock;
+	std::condition_variable	_wake, _drained;
+	std::vector<Record>		_queue;
+	bool					_writing = false, _stop = false, _failed = false;
+	size_t					_written = 0;
+};
+
+// ModelMutator's snapshot and transaction bookkeeping. it lives on
+// the undo system, which outlives the throwaway mutators handed out
+// for each edit; see ModelMutator::beginTransaction.
+struct UndoRedoTransaction
+{
+	// the model as beginSnapshot found it, until pushSnapshot
+	std::unique_ptr<ModelSnapshot>	snapshot;
+	int32_t							depth = 0;
+	// every state pushed while it's open, in order
+	UndoRedoCombinedState			states;
+	// the renderer missed a change while it was open
+	bool							dirty = false;
+	// a transaction in it rolled back, so the outermost will too
+	bool							aborted = false;
+};
+
 class UndoRedo
 {
 public:
-	UndoRedoStateList &List() { return _list; }
+	// handles of the oldest state and one past the newest
+	UndoRedoHandle Begin() const { return _begin; }
+	UndoRedoHandle End() const { return _end; }
+	// number of states in the history
+	size_t Count() const { return (size_t) (_end - _begin); }
+	// state for the given handle, which must be within [Begin, End)
+	UndoRedoState *Get(UndoRedoHandle handle) const { return _ring[Slot(handle)].get(); }
 	// total byte size of current data
 	const size_t &Size() const { return _size; }
-	// pointer to where we are in the linked list; if this is
-	// null, we have not performed any operations yet (are at the head).
-	const UndoRedoStatePointer &Pointer() const { return _pointer; }
+	// memory budget, in bytes
+	size_t Budget() const;
+	// number of states (and their total size) that have
+	// been dropped to stay within the budget
+	size_t EvictedCount() const { return _evictedCount; }
+	size_t EvictedSize() const { return _evictedSize; }
+	// number of states currently in the spill file,
+	// and their compressed size
+	size_t SpilledCount() const { return _spilledCount; }
+	size_t SpilledSize() const { return _spilledSize; }
+	// number of checkpoints held, and their compressed size
+	size_t CheckpointCount() const { return _checkpoints.size(); }
+	size_t CheckpointSize() const { return _checkpointSize; }
+	// timing totals per state class, keyed by Id()
+	const std::map<std::string_view, UndoRedoClassStats> &ClassStats() const { return _classStats; }
+	void ResetClassStats() { _classStats.clear(); }
+	// handle of the first state that is not applied; if this is
+	// End(), every state is applied (we are at the head).
+	UndoRedoHandle Pointer() const { return _pointer; }
 
 	// push a new state onto the head stack.
 	// the undo/redo manager takes control of the pointer.
@@ -199,11 +490,18 @@ public:
 	// temporarily disable undo/redo pushing
 	void BeginDisabled() { _disabled = true; }
 	void EndDisabled() { _disabled = false; }
+	bool IsDisabled() const { return _disabled; }
+
+	// see UndoRedoTransaction
+	UndoRedoTransaction &Transaction() { return _transaction; }
 
 	// clear entire stack
 	void Clear();
 
-	// shrink to fit max undo/redo buffer size
+	// shrink to fit max undo/redo buffer size. states furthest
+	// from the pointer are moved to the spill file first; if
+	// that isn't possible, states that are currently applied
+	// (behind the pointer) are dropped, oldest first.
 	void Shrink();
 
 	// perform an undo (if possible)
@@ -212,34 +510,143 @@ public:
 	// perform a redo (if possible)
 	void Redo();
 
-	// change the pointer to the given iterator
-	void SetPointer(UndoRedoStateIterator it, bool ahead);
+	// move the pointer to the given handle, undoing or
+	// redoing every state in between; long jumps start from
+	// the nearest usable checkpoint instead.
+	void SetPointer(UndoRedoHandle handle);
 
 	// check if we can perform an undo
-	inline bool CanUndo() { return _list.size() && _pointer != _list.begin(); }
+	inline bool CanUndo() { return _pointer != _begin; }
 
 	// check if we can perform a redo
-	inline bool CanRedo() { return _list.size() && _pointer.has_value(); }
+	inline bool CanRedo() { return _pointer != _end; }
+
+	// start a new journal at `path` that holds the whole
+	// current history; later changes are appended to it.
+	bool StartJournal(const std::filesystem::path &path);
+
+	// rebuild the history from the journal at `path`, up to the
+	// `committed` offset stored with the model. anything after
+	// that is held until it is recovered or discarded.
+	bool OpenJournal(const std::filesystem::path &path, size_t committed);
+
+	// the journal being written to, if any
+	const UndoRedoJournal *Journal() const { return _journal.get(); }
+
+	// wait for the journal to be written, compacting it if it
+	// has outgrown the history; returns the offset to store
+	// with the model being saved.
+	std::optional<size_t> CommitJournal();
+
+	// number of unsaved records found by OpenJournal
+	size_t RecoverableCount() const { return _journalTail.size(); }
+
+	// replay the unsaved records onto the model, or throw
+	// them away; either way, journaling resumes.
+	void RecoverJournal();
+	void DiscardJournal();
 
 	// check deferred handling; if force is true,
 	// it will run immediately.
 	void RunDeferred(bool force = false);
 
-	// read/write
+	// read/write; state ids are written once, in a table
+	// at the start, and each state refers to its id by index.
+	// `idTable` false reads the older layout, where each
+	// state is preceded by its full id.
 	void Write(std::ostream &stream);
-	void Read(std::istream &stream);
+	void Read(std::istream &stream, bool idTable = true);
 
 private:
 	// saved
-	UndoRedoStateList _list;
+	// states live in a ring indexed by handle; the size is
+	// always a power of two, and grows when full.
+	std::vector<UndoRedoStatePtr> _ring;
+	UndoRedoHandle _begin = 0, _end = 0;
 	size_t _size = 0;
-	UndoRedoStatePointer _pointer = std::nullopt;
+	UndoRedoHandle _pointer = 0;
+
+	inline size_t Slot(UndoRedoHandle handle) const { return (size_t) handle & (_ring.size() - 1); }
+
+	// add a state at the head, growing the ring if needed
+	void Append(UndoRedoState *state);
+
+	// erase the given range, keeping _size in sync; the range
+	// must touch either end of the history.
+	void Erase(UndoRedoHandle first, UndoRedoHandle last);
+
+	// move a state to the spill file / bring it back
+	bool Spill(UndoRedoHandle handle);
+	void Fault(UndoRedoHandle handle);
+
+	// a compressed snapshot of frames, meshes and selection,
+	// as they were when the pointer was at its key.
+	struct Checkpoint
+	{
+		std::string	data;
+		size_t		size;
+	};
+
+	// pushes this close together may be coalesced
+	static constexpr std::chrono::milliseconds COALESCE_WINDOW { 1000 };
+
+	// a checkpoint is taken every this many pushes
+	static constexpr UndoRedoHandle CHECKPOINT_INTERVAL = 64;
+	// restoring a checkpoint is counted as this many replays
+	// when deciding whether it's worth using
+	static constexpr UndoRedoHandle CHECKPOINT_RESTORE_COST = 16;
+
+	void TakeCheckpoint();
+	// the checkpoint that reaches `target` with the fewest
+	// replays, if any beats replaying from the pointer
+	std::optional<UndoRedoHandle> FindCheckpoint(UndoRedoHandle target) const;
+	void RestoreCheckpoint(UndoRedoHandle handle);
+
+	// swap the state at `handle` for `state`
+	void ReplaceState(UndoRedoHandle handle, UndoRedoState *state);
+
+	// run a state, recording how long it took
+	void RunUndo(UndoRedoState &state, ModelData *data);
+	void RunRedo(UndoRedoState &state, ModelData *data);
+	void RunWrite(const UndoRedoState &state, std::ostream &stream);
+
+	void JournalState(UndoRedoJournal::RecordType type, const UndoRedoState &state);
+	void JournalPointer();
+	void ApplyJournalRecord(const UndoRedoJournal::Record &record, bool applyToModel);
+
+	// the journal only ever grows; on commit, once it holds this many
+	// times the records the live history needs (and at least the
+	// minimum), it is rewritten to hold just the live history.
+	static constexpr size_t JOURNAL_COMPACT_RATIO = 2;
+	static constexpr size_t JOURNAL_COMPACT_MIN = 256;
+
+	// rewrite the journal from the live history; the old
+	// journal is kept if the new one can't be written.
+	void CompactJournal();
 
 	// not saved
+	std::unique_ptr<UndoRedoJournal> _journal;
+	// journal index 0 is this handle
+	UndoRedoHandle _journalBase = 0;
+	// held by OpenJournal until recovered/discarded
+	std::filesystem::path _journalPath;
+	size_t _journalCommitted = 0, _journalEnd = 0;
+	// records in the journal file, to decide when to compact it
+	size_t _journalRecords = 0;
+	std::vector<UndoRedoJournal::Record> _journalTail;
+	std::optional<std::chrono::steady_clock::time_point> _lastPush;
+	std::map<std::string_view, UndoRedoClassStats> _classStats;
+	std::map<UndoRedoHandle, Checkpoint> _checkpoints;
+	size_t _checkpointSize = 0;
+	size_t _evictedCount = 0, _evictedSize = 0;
+	std::unique_ptr<UndoRedoSpillFile> _spill;
+	size_t _spilledCount = 0, _spilledSize = 0;
 	std::function<void()> _deferredUndo {};
 	double _deferTime = 0;
 	bool *_deferHandle = nullptr;
+	bool _pushingDeferred = false;
 	bool _disabled = false;
+	UndoRedoTransaction _transaction;
 
 	friend class UndoRedoState;
 };
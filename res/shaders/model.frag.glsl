@@ -5,6 +5,9 @@ precision mediump float;
 #include "ubo.glsl"
 
 uniform sampler2D u_texture;
+uniform sampler2D u_palette; // 256x1 RGBA, only used if u_paletted
+uniform bool u_paletted; // u_texture holds palette indices
+uniform bool u_filtered; // bilinear filtering for paletted textures
 uniform bool u_shaded; // light affects polygonal rendering (3d only)
 uniform bool u_2d; // use 2D color set
 uniform int u_line; // is wireframe (1), or is overlay enabled (2)
@@ -45,9 +48,38 @@ float gridFactor (vec2 vBC, float width)
 	return min(min(a3.x, a3.y), a3.z);
 }
 
+vec4 paletteColor (ivec2 pos)
+{
+	pos = clamp(pos, ivec2(0), textureSize(u_texture, 0) - 1);
+	int index = int(texelFetch(u_texture, pos, 0).r * 255.0 + 0.5);
+	return texelFetch(u_palette, ivec2(index, 0), 0);
+}
+
+// indices can't be filtered, so paletted skins resolve
+// each texel and filter the colors by hand.
+vec4 sampleSkin (vec2 tc)
+{
+	if (!u_paletted)
+		return texture2D(u_texture, tc);
+
+	vec2 st = tc * vec2(textureSize(u_texture, 0));
+
+	if (!u_filtered)
+		return paletteColor(ivec2(floor(st)));
+
+	st -= 0.5;
+	ivec2 i = ivec2(floor(st));
+	vec2 f = fract(st);
+
+	return mix(
+		mix(paletteColor(i), paletteColor(i + ivec2(1, 0)), f.x),
+		mix(paletteColor(i + ivec2(0, 1)), paletteColor(i + ivec2(1, 1)), f.x),
+		f.y);
+}
+
 void main()
 {
-	o_color = texture2D(u_texture, v_texcoord);
+	o_color = sampleSkin(v_texcoord);
 	
 	if (u_shaded)
 	{